@@ -0,0 +1,249 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SDBenchmark.h"
+#include "SDCRC.h"
+
+namespace SDBenchmark
+{
+
+namespace
+{
+//Measures elapsed CPU cycles using the DWT cycle counter if available, or a Timer otherwise
+class CycleCounter
+{
+public:
+    void start()
+    {
+#if defined(DWT_CTRL_CYCCNTENA_Msk)
+        CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+        DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+        m_Start = DWT->CYCCNT;
+#else
+        m_Timer.reset();
+        m_Timer.start();
+#endif
+    }
+
+    unsigned int elapsed()
+    {
+#if defined(DWT_CTRL_CYCCNTENA_Msk)
+        return DWT->CYCCNT - m_Start;
+#else
+        m_Timer.stop();
+        return m_Timer.read_us() * (SystemCoreClock / 1000000);
+#endif
+    }
+
+private:
+#if defined(DWT_CTRL_CYCCNTENA_Msk)
+    unsigned int m_Start;
+#else
+    Timer m_Timer;
+#endif
+};
+
+//Fills a buffer with repeatable pseudo-random data
+void fillPattern(char* buffer, int length, unsigned int seed)
+{
+    for (int i = 0; i < length; i++) {
+        seed = seed * 1103515245 + 12345;
+        buffer[i] = seed >> 16;
+    }
+}
+
+//Measures the cost of a single CRC16 backend
+void crcBackend(FILE* out, const char* name, unsigned short (*backend)(const char*, int), const char* block, int iterations)
+{
+    CycleCounter counter;
+    volatile unsigned short crc = 0;
+
+    //Checksum the same block repeatedly
+    counter.start();
+    for (int i = 0; i < iterations; i++)
+        crc = backend(block, 512);
+    unsigned int cycles = counter.elapsed();
+
+    //Print the result, checked against the reference implementation
+    fprintf(out, "crc16,%s,%u,%s\n", name, cycles / iterations, (crc == SDCRC::crc16_table(block, 512)) ? "pass" : "fail");
+}
+
+//Prints a throughput result with the current driver configuration
+void printThroughput(FILE* out, SDDisk& sd, const char* test, const char* op, int sectors, unsigned long long bytes, int us, bool passed)
+{
+    unsigned int rate = (us > 0) ? (unsigned int)((bytes * 1000000) / us) : 0;
+    fprintf(out, "%s,%d,%d,%d,%d,%s,%d,%u,%s\n", test, sd.frequency(), sd.large_frames(), sd.crc(), sd.write_validation(), op, sectors, rate, passed ? "pass" : "fail");
+}
+}
+
+void crc(FILE* out, int iterations)
+{
+    //Use a word aligned block of test data
+    uint32_t storage[128];
+    char* block = (char*)storage;
+    fillPattern(block, 512, 0x5D);
+
+    //Measure each backend
+    fprintf(out, "# test,backend,cycles_per_512B,result\n");
+    crcBackend(out, "table", &SDCRC::crc16_table, block, iterations);
+    crcBackend(out, "slice4", &SDCRC::crc16_slice4, block, iterations);
+    crcBackend(out, "slice8", &SDCRC::crc16_slice8, block, iterations);
+    crcBackend(out, "word", &SDCRC::crc16_word, block, iterations);
+#if SDCRC_HW_AVAILABLE
+    crcBackend(out, "hw", &SDCRC::crc16_hw, block, iterations);
+#endif
+}
+
+void disk(SDDisk& sd, FILE* out, int max_sectors, int iterations)
+{
+    Timer timer;
+
+    //Use the sectors at the end of the card
+    char* buffer = new char[max_sectors * 512];
+    uint32_t lba = sd.disk_sectors() - max_sectors;
+
+    //Measure each transfer size
+    fprintf(out, "# test,hz,large_frames,crc,validation,op,sectors,bytes_per_sec,result\n");
+    for (int sectors = 1; sectors <= max_sectors; sectors <<= 1) {
+        bool passed = true;
+
+        //Measure the read throughput
+        timer.reset();
+        timer.start();
+        for (int i = 0; i < iterations; i++) {
+            if (sd.disk_read((uint8_t*)buffer, lba, sectors) != 0)
+                passed = false;
+        }
+        timer.stop();
+        printThroughput(out, sd, "disk", "read", sectors, (unsigned long long)sectors * 512 * iterations, timer.read_us(), passed);
+
+        //Measure the write throughput by writing back the sectors just read (including the final sync)
+        timer.reset();
+        timer.start();
+        for (int i = 0; i < iterations && passed; i++) {
+            if (sd.disk_write((const uint8_t*)buffer, lba, sectors) != 0)
+                passed = false;
+        }
+        if (sd.disk_sync() != 0)
+            passed = false;
+        timer.stop();
+        printThroughput(out, sd, "disk", "write", sectors, (unsigned long long)sectors * 512 * iterations, timer.read_us(), passed);
+    }
+
+    //Release the buffer
+    delete[] buffer;
+}
+
+void file(SDFileSystem& sd, const char* path, FILE* out, int max_sectors, int iterations)
+{
+    Timer timer;
+
+    //Use a buffer of repeatable test data
+    int length = max_sectors * 512;
+    char* buffer = new char[length];
+    char* check = new char[length];
+    fillPattern(buffer, length, 0xA5);
+
+    //Measure each chunk size
+    fprintf(out, "# test,hz,large_frames,crc,validation,op,sectors,bytes_per_sec,result\n");
+    for (int sectors = 1; sectors <= max_sectors; sectors <<= 1) {
+        int chunk = sectors * 512;
+        unsigned long long bytes = (unsigned long long)length * iterations;
+        bool passed = true;
+
+        //Measure the write throughput (including closing the file)
+        timer.reset();
+        timer.start();
+        FILE* fp = fopen(path, "wb");
+        if (fp != NULL) {
+            for (int i = 0; i < iterations; i++) {
+                for (int offset = 0; offset < length; offset += chunk) {
+                    if (fwrite(buffer + offset, 1, chunk, fp) != (size_t)chunk)
+                        passed = false;
+                }
+            }
+            if (fclose(fp) != 0)
+                passed = false;
+        } else {
+            passed = false;
+        }
+        timer.stop();
+        printThroughput(out, sd, "file", "fwrite", sectors, bytes, timer.read_us(), passed);
+
+        //Measure the read throughput, verifying the data afterwards
+        timer.reset();
+        timer.start();
+        fp = fopen(path, "rb");
+        if (fp != NULL) {
+            for (int i = 0; i < iterations; i++) {
+                for (int offset = 0; offset < length; offset += chunk) {
+                    if (fread(check + offset, 1, chunk, fp) != (size_t)chunk)
+                        passed = false;
+                }
+            }
+            fclose(fp);
+        } else {
+            passed = false;
+        }
+        timer.stop();
+        if (memcmp(buffer, check, length) != 0)
+            passed = false;
+        printThroughput(out, sd, "file", "fread", sectors, bytes, timer.read_us(), passed);
+    }
+
+    //Remove the scratch file, and release the buffers
+    remove(path);
+    delete[] buffer;
+    delete[] check;
+}
+
+void sweep(SDFileSystem& sd, const char* path, const int* frequencies, int count, FILE* out, int max_sectors)
+{
+    //Remember the original configuration
+    int frequency = sd.frequency();
+    bool largeFrames = sd.large_frames();
+    bool crc = sd.crc();
+    SDFileSystem::ValidationMode validation = sd.validation_mode();
+
+    //Measure every combination of options at each frequency
+    for (int f = 0; f < count; f++) {
+        //Remount the card to apply the new frequency
+        sd.unmount();
+        sd.frequency(frequencies[f]);
+        if (sd.mount() != 0) {
+            fprintf(out, "# mount failed at %dHz\n", frequencies[f]);
+            continue;
+        }
+
+        for (int options = 0; options < 8; options++) {
+            sd.large_frames(options & 0x1);
+            sd.crc(options & 0x2);
+            sd.write_validation(options & 0x4);
+            disk(sd, out, max_sectors);
+            file(sd, path, out, max_sectors);
+        }
+    }
+
+    //Restore the original configuration
+    sd.unmount();
+    sd.frequency(frequency);
+    sd.large_frames(largeFrames);
+    sd.crc(crc);
+    sd.validation_mode(validation);
+    sd.mount();
+}
+
+}
@@ -0,0 +1,103 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_BENCHMARK_H
+#define SD_BENCHMARK_H
+
+#include "mbed.h"
+#include "SDFileSystem.h"
+
+/** SDBenchmark namespace.
+ *  On-target benchmarks for the SD/MMC file system library.
+ *
+ *  Results are printed one per line as comma separated values, preceded by a
+ *  header line starting with '#', so they can be collected from a serial log
+ *  and compared between cards, targets and library releases.
+ *
+ * Example:
+ * @code
+ * #include "mbed.h"
+ * #include "SDBenchmark.h"
+ *
+ * //Create an SDFileSystem object
+ * SDFileSystem sd(p5, p6, p7, p20, "sd");
+ *
+ * int main()
+ * {
+ *     //Report the cost of each CRC16 backend
+ *     SDBenchmark::crc(stdout);
+ *
+ *     //Sweep the SPI frequency and driver options
+ *     const int frequencies[] = {1000000, 6000000, 12000000, 25000000};
+ *     SDBenchmark::sweep(sd, "/sd/bench.bin", frequencies, 4, stdout);
+ * }
+ * @endcode
+ */
+namespace SDBenchmark
+{
+
+/** Measure the cost of each CRC16 backend
+ *
+ * @param out The stream to print the results to.
+ * @param iterations The number of 512B blocks to checksum per backend.
+ *
+ * @note Prints one line per backend: "crc16,<backend>,<cycles per 512B block>,<pass|fail>"
+ */
+void crc(FILE* out = stdout, int iterations = 64);
+
+/** Measure raw disk_read() and disk_write() throughput for transfer sizes from 1 sector up to max_sectors
+ *
+ * @param sd The initialized SDDisk (or mounted SDFileSystem) to measure.
+ * @param out The stream to print the results to.
+ * @param max_sectors The largest transfer size in sectors (transfer sizes double from 1).
+ * @param iterations The number of transfers per transfer size.
+ *
+ * @note Prints one line per operation and transfer size:
+ *       "disk,<hz>,<large_frames>,<crc>,<validation>,<read|write>,<sectors>,<bytes per second>,<pass|fail>"
+ * @note The sectors at the end of the card are read and then written back unchanged, so the contents of the
+ *       card are preserved unless power is lost during the benchmark.
+ */
+void disk(SDDisk& sd, FILE* out = stdout, int max_sectors = 128, int iterations = 4);
+
+/** Measure FatFs fwrite() and fread() throughput for chunk sizes from 1 sector up to max_sectors
+ *
+ * @param sd The mounted SDFileSystem to measure.
+ * @param path The path of a scratch file to create, such as "/sd/bench.bin" (removed afterwards).
+ * @param out The stream to print the results to.
+ * @param max_sectors The largest chunk size in sectors (chunk sizes double from 1).
+ * @param iterations The number of chunks of max_sectors to transfer per chunk size.
+ *
+ * @note Prints one line per operation and chunk size:
+ *       "file,<hz>,<large_frames>,<crc>,<validation>,<fwrite|fread>,<sectors>,<bytes per second>,<pass|fail>"
+ */
+void file(SDFileSystem& sd, const char* path, FILE* out = stdout, int max_sectors = 128, int iterations = 4);
+
+/** Run disk() and file() for every combination of SPI frequency, large_frames(), crc() and write_validation()
+ *
+ * @param sd The SDFileSystem to measure (remounted for each SPI frequency).
+ * @param path The path of a scratch file to create, such as "/sd/bench.bin" (removed afterwards).
+ * @param frequencies An array of SPI bus frequencies in Hz.
+ * @param count The number of SPI bus frequencies.
+ * @param out The stream to print the results to.
+ * @param max_sectors The largest transfer size in sectors.
+ *
+ * @note The original frequency and options are restored afterwards.
+ */
+void sweep(SDFileSystem& sd, const char* path, const int* frequencies, int count, FILE* out = stdout, int max_sectors = 128);
+
+}
+
+#endif
@@ -19,12 +19,50 @@
 
 #include "mbed.h"
 
+//CRC16 backends
+#define SDCRC_BACKEND_TABLE     0   /**< Byte-at-a-time table lookup (512B of tables) */
+#define SDCRC_BACKEND_SLICE4    1   /**< Slice-by-4 table lookup (2kB of tables) */
+#define SDCRC_BACKEND_SLICE8    2   /**< Slice-by-8 table lookup (4kB of tables) */
+#define SDCRC_BACKEND_WORD      3   /**< Slice-by-4 table lookup using aligned 32-bit loads (2kB of tables) */
+#define SDCRC_BACKEND_HW        4   /**< MCU CRC peripheral (STM32 with programmable polynomial, Kinetis, LPC408x) */
+
+//Determine whether or not this target has a CRC peripheral that can calculate CRC-CCITT
+#if defined(TARGET_STM) && defined(CRC_POL_POL)
+#define SDCRC_HW_AVAILABLE 1
+#elif defined(CRC0) && defined(SIM_SCGC6_CRC_MASK)
+#define SDCRC_HW_AVAILABLE 1
+#elif defined(TARGET_LPC408X)
+#define SDCRC_HW_AVAILABLE 1
+#else
+#define SDCRC_HW_AVAILABLE 0
+#endif
+
+//Select the CRC16 backend at compile time (slice-by-8 unless the CRC peripheral is requested)
+//The CRC peripheral is reprogrammed on every call, so crc16_hw() serializes SDCRC's own callers with a mutex,
+//but it must not be selected if the application or the HAL also uses the peripheral
+#ifndef SDCRC_BACKEND
+#define SDCRC_BACKEND SDCRC_BACKEND_SLICE8
+#endif
+
+#if SDCRC_BACKEND == SDCRC_BACKEND_HW && !SDCRC_HW_AVAILABLE
+#error "SDCRC_BACKEND_HW selected, but this target has no supported CRC peripheral"
+#endif
+
 namespace SDCRC
 {
 
 char crc7(const char* data, int length);
 unsigned short crc16(const char* data, int length);
 
+//Individual CRC16 backends (crc16() forwards to the one selected by SDCRC_BACKEND)
+unsigned short crc16_table(const char* data, int length);
+unsigned short crc16_slice4(const char* data, int length);
+unsigned short crc16_slice8(const char* data, int length);
+unsigned short crc16_word(const char* data, int length);
+#if SDCRC_HW_AVAILABLE
+unsigned short crc16_hw(const char* data, int length);  //Not safe alongside other users of the CRC peripheral
+#endif
+
 }
 
 #endif
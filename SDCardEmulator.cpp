@@ -0,0 +1,539 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SDCardEmulator.h"
+#include "SDCRC.h"
+#include <string.h>
+
+SDCardEmulator::SDCardEmulator(char* storage, unsigned int sectors)
+{
+    //Initialize the member variables
+    m_Storage = storage;
+    m_Sectors = sectors;
+    m_Selected = false;
+    m_Bits = 8;
+    m_Hz = 1000000;
+    m_StableHz = 0;
+    m_NsPerByte = 8000;
+    m_NowNs = 0;
+    m_ReadyNs = 0;
+    m_DataReadyNs = 0;
+    m_ReadLatencyNs = 100000;
+    m_ProgramNs = 500000;
+    m_Idle = true;
+    m_AppCommand = false;
+    m_EraseStart = 1;
+    m_EraseEnd = 0;
+    m_Crc = false;
+    m_InitPolls = 2;
+    m_InitCount = 0;
+    m_CommandCrcErrors = 0;
+    m_ReadCrcErrors = 0;
+    m_WriteCrcErrors = 0;
+    m_CommandLength = 0;
+    m_ResponseLength = 0;
+    m_ResponseIndex = 0;
+    m_State = STATE_IDLE;
+    m_Multiple = false;
+    m_Lba = 0;
+    m_Block = NULL;
+    m_BlockLength = 0;
+    m_BlockIndex = -1;
+    m_BlockCrc = 0;
+    m_WrittenBlocks = 0;
+    reset_counters();
+}
+
+void SDCardEmulator::frequency(int hz)
+{
+    //Each byte takes 8 bus clocks
+    if (hz > 0) {
+        m_Hz = hz;
+        m_NsPerByte = 8000000000ULL / hz;
+    }
+}
+
+void SDCardEmulator::format(int bits)
+{
+    //Set the frame size
+    m_Bits = bits;
+}
+
+int SDCardEmulator::write(int value)
+{
+    //Exchange 16-bit frames MSB first
+    if (m_Bits == 16) {
+        int high = (unsigned char)exchange(value >> 8);
+        int low = (unsigned char)exchange(value);
+        return (high << 8) | low;
+    }
+
+    //Exchange an 8-bit frame
+    return (unsigned char)exchange(value);
+}
+
+void SDCardEmulator::chip_select(bool asserted)
+{
+    //Deselecting the card abandons any partial command packet
+    m_Selected = asserted;
+    if (!asserted)
+        m_CommandLength = 0;
+}
+
+bool SDCardEmulator::start_transfer(const char* txBuffer, char* rxBuffer, int length)
+{
+    //Complete the bulk transfer synchronously, sending 0xFF if there's nothing to send
+    for (int i = 0; i < length; i++) {
+        char value = exchange((txBuffer != NULL) ? txBuffer[i] : (char)0xFF);
+        if (rxBuffer != NULL)
+            rxBuffer[i] = value;
+    }
+    return true;
+}
+
+bool SDCardEmulator::transfer(const char* txBuffer, char* rxBuffer, int length)
+{
+    //Exchange the block one byte at a time, sending 0xFF if there's nothing to send
+    for (int i = 0; i < length; i++) {
+        char value = exchange((txBuffer != NULL) ? txBuffer[i] : (char)0xFF);
+        if (rxBuffer != NULL)
+            rxBuffer[i] = value;
+    }
+    return true;
+}
+
+void SDCardEmulator::init_polls(int polls)
+{
+    //Set the number of ACMD41 polls before the card is ready
+    m_InitPolls = polls;
+}
+
+void SDCardEmulator::read_latency(int us)
+{
+    //Set the access time before each data block
+    m_ReadLatencyNs = (unsigned long long)us * 1000;
+}
+
+void SDCardEmulator::program_time(int us)
+{
+    //Set the busy period after each data block
+    m_ProgramNs = (unsigned long long)us * 1000;
+}
+
+void SDCardEmulator::max_stable_frequency(int hz)
+{
+    //Set the highest reliable bus frequency
+    m_StableHz = hz;
+}
+
+void SDCardEmulator::inject_command_crc_errors(int count)
+{
+    //Reject the next commands with a CRC error
+    m_CommandCrcErrors = count;
+}
+
+void SDCardEmulator::inject_read_crc_errors(int count)
+{
+    //Corrupt the next data blocks sent to the host
+    m_ReadCrcErrors = count;
+}
+
+void SDCardEmulator::inject_write_crc_errors(int count)
+{
+    //Reject the next data blocks written by the host
+    m_WriteCrcErrors = count;
+}
+
+unsigned int SDCardEmulator::command_count(int index, bool app)
+{
+    //Return the number of times the command was received
+    return m_CommandCounts[app ? 1 : 0][index & 0x3F];
+}
+
+unsigned long long SDCardEmulator::bytes()
+{
+    //Return the number of bytes clocked
+    return m_Bytes;
+}
+
+unsigned long long SDCardEmulator::elapsed_ns()
+{
+    //Return the modeled bus time
+    return m_NowNs - m_StartNs;
+}
+
+void SDCardEmulator::reset_counters()
+{
+    //Clear the counters (the modeled clock keeps running so busy periods stay consistent)
+    memset(m_CommandCounts, 0, sizeof(m_CommandCounts));
+    m_Bytes = 0;
+    m_StartNs = m_NowNs;
+}
+
+char SDCardEmulator::exchange(char value)
+{
+    //Advance the modeled bus time
+    m_Bytes++;
+    m_NowNs += m_NsPerByte;
+
+    //The card ignores the bus while it's deselected
+    if (!m_Selected)
+        return 0xFF;
+
+    //Work out what the card sends while this byte is clocked in
+    char out = readByte();
+
+    //Collect command packets whenever the card can accept one, and data otherwise
+    bool receivingData = (m_State == STATE_WRITE && m_BlockIndex >= 0);
+    if (m_CommandLength > 0 || ((value & 0xC0) == 0x40 && !receivingData && m_NowNs >= m_ReadyNs)) {
+        m_Command[m_CommandLength++] = value;
+        if (m_CommandLength == 6) {
+            m_CommandLength = 0;
+            executeCommand();
+        }
+    } else {
+        writeByte(value);
+    }
+
+    return out;
+}
+
+char SDCardEmulator::readByte()
+{
+    //Send any queued response bytes first
+    if (m_ResponseIndex < m_ResponseLength)
+        return m_Response[m_ResponseIndex++];
+
+    //Hold DO low while the card is busy
+    if (m_NowNs < m_ReadyNs)
+        return 0x00;
+
+    //Send nothing unless a data block is in progress
+    if (m_State != STATE_READ)
+        return 0xFF;
+
+    if (m_BlockIndex < 0) {
+        //Send the start block token once the access time has elapsed
+        if (m_NowNs < m_DataReadyNs)
+            return 0xFF;
+        m_BlockIndex = 0;
+        return 0xFE;
+    } else if (m_BlockIndex < m_BlockLength) {
+        //Send the next data byte, corrupting the first one if the bus is clocked too fast
+        if (m_BlockIndex == 0 && m_StableHz > 0 && m_Hz > m_StableHz)
+            return ~m_Block[m_BlockIndex++];
+        return m_Block[m_BlockIndex++];
+    } else if (m_BlockIndex == m_BlockLength) {
+        //Send the first CRC16 byte
+        m_BlockIndex++;
+        return m_BlockCrc >> 8;
+    } else {
+        //Send the last CRC16 byte, then move on to the next sector for CMD18 or finish the transfer
+        char out = m_BlockCrc;
+        if (m_Multiple && m_Lba + 1 < m_Sectors) {
+            m_Lba++;
+            startBlock(m_Storage + (size_t)m_Lba * 512, 512);
+        } else {
+            m_State = STATE_IDLE;
+        }
+        return out;
+    }
+}
+
+void SDCardEmulator::writeByte(char value)
+{
+    //Data is only accepted during CMD24/CMD25
+    if (m_State != STATE_WRITE)
+        return;
+
+    //Wait for a start block token, or the stop tran token during CMD25
+    if (m_BlockIndex < 0) {
+        if ((value == (char)0xFE && !m_Multiple) || (value == (char)0xFC && m_Multiple)) {
+            m_BlockIndex = 0;
+        } else if (value == (char)0xFD && m_Multiple) {
+            m_State = STATE_IDLE;
+            m_ReadyNs = m_NowNs + 2 * m_NsPerByte;
+        }
+        return;
+    }
+
+    //Receive the data block and its CRC16 checksum
+    m_WriteBuffer[m_BlockIndex++] = value;
+    if (m_BlockIndex == 514)
+        finishWrite();
+}
+
+void SDCardEmulator::executeCommand()
+{
+    //Decode the command packet
+    int index = m_Command[0] & 0x3F;
+    unsigned int arg = ((unsigned char)m_Command[1] << 24) | ((unsigned char)m_Command[2] << 16) | ((unsigned char)m_Command[3] << 8) | (unsigned char)m_Command[4];
+    bool app = m_AppCommand;
+    m_AppCommand = false;
+    m_CommandCounts[app ? 1 : 0][index]++;
+    char r1 = m_Idle ? 0x01 : 0x00;
+
+    //Check the CRC7 checksum (always checked for CMD0 and CMD8), and any injected errors
+    bool crcValid = (m_Command[5] == (char)((SDCRC::crc7(m_Command, 5) << 1) | 0x01));
+    if (((m_Crc || index == 0 || index == 8) && !crcValid) || m_CommandCrcErrors > 0) {
+        if (m_CommandCrcErrors > 0)
+            m_CommandCrcErrors--;
+        respond(r1 | 0x08);
+        return;
+    }
+
+    //Handle application specific commands
+    if (app) {
+        switch (index) {
+        case 13:
+            //Send the SD status (4MB allocation units)
+            respond(r1, 1, 0x00);
+            memset(m_Register, 0, 64);
+            m_Register[10] = 0x90;
+            startBlock(m_Register, 64);
+            return;
+        case 22:
+            //Send the number of well written blocks from the last write command
+            respond(r1);
+            m_Register[0] = m_WrittenBlocks >> 24;
+            m_Register[1] = m_WrittenBlocks >> 16;
+            m_Register[2] = m_WrittenBlocks >> 8;
+            m_Register[3] = m_WrittenBlocks;
+            startBlock(m_Register, 4);
+            return;
+        case 23:
+        case 42:
+            //Accept the pre-erase count and card detect settings
+            respond(r1);
+            return;
+        case 41:
+            //Leave the idle state after enough polls
+            if (m_Idle && ++m_InitCount >= m_InitPolls)
+                m_Idle = false;
+            respond(m_Idle ? 0x01 : 0x00);
+            return;
+        default:
+            //Treat anything else as a standard command
+            break;
+        }
+    }
+
+    //Data commands are illegal in the idle state
+    if (m_Idle && (index == 6 || index == 9 || index == 10 || index == 17 || index == 18 || index == 24 || index == 25 || index == 32 || index == 33 || index == 38)) {
+        respond(r1 | 0x04);
+        return;
+    }
+
+    //Handle standard commands
+    switch (index) {
+    case 0:
+        //Reset the card
+        m_Idle = true;
+        m_Crc = false;
+        m_InitCount = 0;
+        m_State = STATE_IDLE;
+        respond(0x01);
+        break;
+    case 6:
+        //Send the switch function status (supporting high speed in function group 1)
+        respond(r1);
+        memset(m_Register, 0, 64);
+        m_Register[1] = 0x64;
+        m_Register[12] = 0x80;
+        m_Register[13] = 0x03;
+        m_Register[16] = ((arg & 0x0F) <= 0x01) ? (arg & 0x0F) : (((arg & 0x0F) == 0x0F) ? 0x00 : 0x0F);
+        m_Register[17] = 0x01;
+        startBlock(m_Register, 64);
+        break;
+    case 8:
+        //Echo the voltage range and check pattern
+        respond(r1, 4, arg & 0xFFF);
+        break;
+    case 9: {
+        //Send a version 2.0 CSD
+        unsigned int size = (m_Sectors >> 10) - 1;
+        memset(m_Register, 0, 16);
+        m_Register[0] = 0x40;
+        m_Register[1] = 0x0E;
+        m_Register[3] = 0x32;
+        m_Register[4] = 0x5B;
+        m_Register[5] = 0x59;
+        m_Register[7] = (size >> 16) & 0x3F;
+        m_Register[8] = size >> 8;
+        m_Register[9] = size;
+        m_Register[10] = 0x7F;
+        m_Register[11] = 0x80;
+        m_Register[12] = 0x0A;
+        m_Register[13] = 0x40;
+        m_Register[15] = (SDCRC::crc7(m_Register, 15) << 1) | 0x01;
+        respond(r1);
+        startBlock(m_Register, 16);
+        break;
+    }
+    case 10:
+        //Send the CID
+        memcpy(m_Register, "\x00" "EM" "SDEMU" "\x10" "\x12\x34\x56\x78" "\x01\x6A", 15);
+        m_Register[15] = (SDCRC::crc7(m_Register, 15) << 1) | 0x01;
+        respond(r1);
+        startBlock(m_Register, 16);
+        break;
+    case 12:
+        //Stop the current data transfer
+        m_State = STATE_IDLE;
+        respond(r1);
+        break;
+    case 13:
+        //Send the R2 card status
+        respond(r1, 1, 0x00);
+        break;
+    case 16:
+        //Only 512B blocks are supported
+        respond((arg == 512) ? r1 : r1 | 0x40);
+        break;
+    case 17:
+    case 18:
+        //Start reading from the requested sector
+        if (arg >= m_Sectors) {
+            respond(r1 | 0x20);
+            break;
+        }
+        respond(r1);
+        m_Multiple = (index == 18);
+        m_Lba = arg;
+        startBlock(m_Storage + (size_t)m_Lba * 512, 512);
+        break;
+    case 24:
+    case 25:
+        //Start writing to the requested sector
+        if (arg >= m_Sectors) {
+            respond(r1 | 0x20);
+            break;
+        }
+        respond(r1);
+        m_State = STATE_WRITE;
+        m_Multiple = (index == 25);
+        m_Lba = arg;
+        m_BlockIndex = -1;
+        m_WrittenBlocks = 0;
+        break;
+    case 32:
+    case 33:
+        //Set the first or last block to erase
+        if (arg >= m_Sectors) {
+            respond(r1 | 0x20);
+            break;
+        }
+        if (index == 32)
+            m_EraseStart = arg;
+        else
+            m_EraseEnd = arg;
+        respond(r1);
+        break;
+    case 38:
+        //Erase the blocks to zeros, and stay busy for one programming time per 4MB
+        if (m_EraseStart > m_EraseEnd || m_EraseEnd >= m_Sectors) {
+            respond(r1 | 0x02);
+            break;
+        }
+        memset(m_Storage + (size_t)m_EraseStart * 512, 0, (size_t)(m_EraseEnd - m_EraseStart + 1) * 512);
+        respond(r1);
+        m_ReadyNs = m_NowNs + m_ProgramNs * (1 + (m_EraseEnd - m_EraseStart) / 8192);
+        m_EraseStart = 1;
+        m_EraseEnd = 0;
+        break;
+    case 55:
+        //The next command is application specific
+        m_AppCommand = true;
+        respond(r1);
+        break;
+    case 58:
+        //Send the OCR (3.2-3.3V, with the power up status and CCS bits set once initialized)
+        respond(r1, 4, m_Idle ? 0x00FF8000 : 0xC0FF8000);
+        break;
+    case 59:
+        //Enable or disable CRC checking
+        m_Crc = (arg & 0x1);
+        respond(r1);
+        break;
+    default:
+        //Everything else is an illegal command
+        respond(r1 | 0x04);
+        break;
+    }
+}
+
+void SDCardEmulator::respond(char r1, int extra, unsigned int value)
+{
+    //Queue one byte of response delay (NCR), the R1 token, and any extra response bytes MSB first
+    m_Response[0] = 0xFF;
+    m_Response[1] = r1;
+    for (int i = 0; i < extra; i++)
+        m_Response[2 + i] = value >> ((extra - 1 - i) * 8);
+    m_ResponseLength = 2 + extra;
+    m_ResponseIndex = 0;
+}
+
+void SDCardEmulator::startBlock(const char* block, int length)
+{
+    //Prepare to send the data block once the access time has elapsed
+    m_State = STATE_READ;
+    m_Block = block;
+    m_BlockLength = length;
+    m_BlockIndex = -1;
+    m_DataReadyNs = m_NowNs + m_ReadLatencyNs;
+
+    //Calculate its checksum, corrupting it if requested
+    m_BlockCrc = SDCRC::crc16(block, length);
+    if (m_ReadCrcErrors > 0) {
+        m_ReadCrcErrors--;
+        m_BlockCrc ^= 0xFFFF;
+    }
+}
+
+void SDCardEmulator::finishWrite()
+{
+    //Corrupt the first byte if the bus is clocked too fast
+    if (m_StableHz > 0 && m_Hz > m_StableHz)
+        m_WriteBuffer[0] = ~m_WriteBuffer[0];
+
+    //Verify the data block, and program it if it's valid
+    char token;
+    unsigned short crc = ((unsigned char)m_WriteBuffer[512] << 8) | (unsigned char)m_WriteBuffer[513];
+    if (m_WriteCrcErrors > 0 || (m_Crc && crc != SDCRC::crc16(m_WriteBuffer, 512))) {
+        //Reject the block with a CRC error
+        if (m_WriteCrcErrors > 0)
+            m_WriteCrcErrors--;
+        token = 0x0B;
+    } else if (m_Lba >= m_Sectors) {
+        //Reject the block with a write error
+        token = 0x0D;
+    } else {
+        //Accept the block, and stay busy while it's programmed
+        memcpy(m_Storage + (size_t)m_Lba * 512, m_WriteBuffer, 512);
+        m_WrittenBlocks++;
+        m_Lba++;
+        m_ReadyNs = m_NowNs + m_NsPerByte + m_ProgramNs;
+        token = 0x05;
+    }
+
+    //Queue the data response token, and wait for the next block during CMD25
+    m_Response[0] = 0xE0 | token;
+    m_ResponseLength = 1;
+    m_ResponseIndex = 0;
+    m_BlockIndex = -1;
+    if (!m_Multiple)
+        m_State = STATE_IDLE;
+}
@@ -0,0 +1,202 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_CARD_EMULATOR_H
+#define SD_CARD_EMULATOR_H
+
+#include "SDTransport.h"
+
+/** SDCardEmulator class.
+ *  A simulated SDHC card in SPI mode, backed by a RAM buffer, for exercising SDFileSystem without hardware.
+ *
+ *  The emulator models R1/R2/R3/R7 responses, start block and data response tokens, access latency
+ *  before each data block, busy periods after programming and erasing, ACMD22 well written block counts, and
+ *  injected command, read and write CRC errors. Time is modeled from the number of bytes clocked at
+ *  the current bus frequency, so elapsed_ns() gives the bus time an operation would take on real
+ *  hardware at that frequency, excluding CPU overhead.
+ *
+ *  The emulator only depends on SDTransport and SDCRC, so it can be built on a host (with
+ *  -funsigned-char to match ARM) as well as on a target.
+ *
+ * Example:
+ * @code
+ * #include "mbed.h"
+ * #include "SDFileSystem.h"
+ * #include "SDCardEmulator.h"
+ *
+ * //Create a 1MB emulated card
+ * char storage[2048 * 512];
+ * SDCardEmulator card(storage, 2048);
+ * SDFileSystem sd(card, "sd");
+ *
+ * int main()
+ * {
+ *     //Reject the next data block with a CRC error, and write 8 sectors
+ *     const char data[8 * 512] = {0};
+ *     card.inject_write_crc_errors(1);
+ *     sd.disk_initialize();
+ *     sd.disk_write((const uint8_t*)data, 0, 8);
+ *     printf("%u bytes in %lluns\n", (unsigned int)card.bytes(), card.elapsed_ns());
+ * }
+ * @endcode
+ */
+class SDCardEmulator : public SDTransport
+{
+public:
+    /** Create an emulated card
+     *
+     * @param storage The RAM backing the card (sectors * 512 bytes, must outlive the emulator).
+     * @param sectors The capacity of the card in 512B sectors (a multiple of 1024).
+     */
+    SDCardEmulator(char* storage, unsigned int sectors);
+
+    virtual void frequency(int hz);
+    virtual void format(int bits);
+    virtual int write(int value);
+    virtual void chip_select(bool asserted);
+    virtual bool start_transfer(const char* txBuffer, char* rxBuffer, int length);
+    virtual bool transfer(const char* txBuffer, char* rxBuffer, int length);
+
+    /** Set the number of ACMD41 polls before the card leaves the idle state
+     *
+     * @param polls The number of ACMD41 commands answered with the idle bit set (defaults to 2).
+     */
+    void init_polls(int polls);
+
+    /** Set the access time before each data block is sent to the host
+     *
+     * @param us The access time in microseconds (defaults to 100us).
+     */
+    void read_latency(int us);
+
+    /** Set the busy period after each data block is programmed
+     *
+     * @param us The programming time in microseconds (defaults to 500us).
+     */
+    void program_time(int us);
+
+    /** Model a marginal board layout by corrupting data blocks clocked above a frequency
+     *
+     * @param hz The highest bus frequency that transfers data reliably (0 for no limit, the default).
+     *
+     * @note Above this frequency, the first byte of every data block is corrupted in both directions.
+     */
+    void max_stable_frequency(int hz);
+
+    /** Respond to the next commands with the CRC error bit set in the R1 response
+     *
+     * @param count The number of commands to reject.
+     */
+    void inject_command_crc_errors(int count);
+
+    /** Send the next data blocks with a corrupted CRC16 checksum
+     *
+     * @param count The number of data blocks to corrupt.
+     */
+    void inject_read_crc_errors(int count);
+
+    /** Reject the next data blocks written by the host with a CRC error data response
+     *
+     * @param count The number of data blocks to reject.
+     */
+    void inject_write_crc_errors(int count);
+
+    /** Get the number of times a command was received
+     *
+     * @param index The command index (0 to 63).
+     * @param app Whether to count the application specific command (ACMDn) instead of CMDn.
+     *
+     * @returns The number of times the command was received since the last reset_counters().
+     */
+    unsigned int command_count(int index, bool app = false);
+
+    /** Get the number of bytes clocked over the bus
+     *
+     * @returns The number of bytes exchanged since the last reset_counters(), selected or not.
+     */
+    unsigned long long bytes();
+
+    /** Get the modeled bus time
+     *
+     * @returns The time taken to clock bytes() at the bus frequencies used, in nanoseconds.
+     */
+    unsigned long long elapsed_ns();
+
+    /** Reset the command, byte and time counters
+     */
+    void reset_counters();
+
+private:
+    //Data transfer states
+    enum State {
+        STATE_IDLE,
+        STATE_READ,
+        STATE_WRITE
+    };
+
+    //Member variables
+    char* m_Storage;
+    unsigned int m_Sectors;
+    bool m_Selected;
+    int m_Bits;
+    int m_Hz;
+    int m_StableHz;
+    unsigned long long m_NsPerByte;
+    unsigned long long m_Bytes;
+    unsigned long long m_NowNs;
+    unsigned long long m_StartNs;
+    unsigned long long m_ReadyNs;
+    unsigned long long m_DataReadyNs;
+    unsigned long long m_ReadLatencyNs;
+    unsigned long long m_ProgramNs;
+    bool m_Idle;
+    bool m_AppCommand;
+    bool m_Crc;
+    int m_InitPolls;
+    int m_InitCount;
+    int m_CommandCrcErrors;
+    int m_ReadCrcErrors;
+    int m_WriteCrcErrors;
+    unsigned int m_CommandCounts[2][64];
+    char m_Command[6];
+    int m_CommandLength;
+    char m_Response[8];
+    int m_ResponseLength;
+    int m_ResponseIndex;
+    SDCardEmulator::State m_State;
+    bool m_Multiple;
+    unsigned int m_Lba;
+    char m_Register[64];
+    const char* m_Block;
+    int m_BlockLength;
+    int m_BlockIndex;
+    unsigned short m_BlockCrc;
+    char m_WriteBuffer[514];
+    unsigned int m_WrittenBlocks;
+    unsigned int m_EraseStart;
+    unsigned int m_EraseEnd;
+
+    //Internal methods
+    char exchange(char value);
+    char readByte();
+    void writeByte(char value);
+    void executeCommand();
+    void respond(char r1, int extra = 0, unsigned int value = 0);
+    void startBlock(const char* block, int length);
+    void finishWrite();
+};
+
+#endif
@@ -0,0 +1,82 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_CONFIG_H
+#define SD_CONFIG_H
+
+#include "mbed.h"
+
+/** Whether or not the RTOS is available for cooperative waiting and bus sharing
+ */
+#ifndef SD_USE_RTOS
+#if defined(MBED_CONF_RTOS_PRESENT)
+#define SD_USE_RTOS 1
+#else
+#define SD_USE_RTOS 0
+#endif
+#endif
+
+#if SD_USE_RTOS
+#include "rtos.h"
+#endif
+
+/** Whether or not SPI::write() supports block transfers (mbed OS 5.5 and later)
+ */
+#ifndef SD_SPI_BLOCK_TRANSFER
+#if defined(MBED_MAJOR_VERSION) && (MBED_MAJOR_VERSION > 5 || (MBED_MAJOR_VERSION == 5 && MBED_MINOR_VERSION >= 5))
+#define SD_SPI_BLOCK_TRANSFER 1
+#else
+#define SD_SPI_BLOCK_TRANSFER 0
+#endif
+#endif
+
+/** Fix CRC on (1) or off (0) at compile time, or leave it configurable at runtime using SDDisk::crc() (-1)
+ *
+ * A fixed setting lets the compiler drop the unused checksum path from the transfer loops,
+ * and SDDisk::crc(bool) is ignored.
+ */
+#ifndef SD_FIXED_CRC
+#define SD_FIXED_CRC -1
+#endif
+
+/** Fix 16-bit (1) or 8-bit (0) data frames at compile time, or leave them configurable at runtime using SDDisk::large_frames() (-1)
+ *
+ * A fixed setting lets the compiler drop the unused frame loop, and SDDisk::large_frames(bool) is ignored.
+ */
+#ifndef SD_FIXED_LARGE_FRAMES
+#define SD_FIXED_LARGE_FRAMES -1
+#endif
+
+/** Fix the write validation policy at compile time, or leave it configurable at runtime using SDDisk::validation_mode() (-1)
+ *
+ * The value is one of the SDDisk::ValidationMode values (0 = VALIDATE_NONE, 1 = VALIDATE_EACH, 2 = VALIDATE_ON_SYNC,
+ * 3 = VALIDATE_EVERY_N). A fixed policy lets the compiler drop the unused checks, and the mode passed to
+ * SDDisk::validation_mode() is ignored (the interval still applies).
+ */
+#ifndef SD_FIXED_VALIDATION
+#define SD_FIXED_VALIDATION -1
+#endif
+
+/** Whether or not only block addressed (SDHC/SDXC) cards are supported
+ *
+ * Byte addressed cards (SDSC and MMC) fail to initialize, and the address conversion is dropped from
+ * every data command.
+ */
+#ifndef SD_SDHC_ONLY
+#define SD_SDHC_ONLY 0
+#endif
+
+#endif
@@ -0,0 +1,3632 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SDDisk.h"
+#include "diskio.h"
+#include "SDCRC.h"
+#include "SDSpiTransport.h"
+
+namespace
+{
+//Calculates the sector count from a CSD register
+uint32_t csdSectors(const char* csd)
+{
+    if ((csd[0] >> 6) == 0x01) {
+        //Calculate the sector count for a high capacity card
+        unsigned int size = (((csd[7] & 0x3F) << 16) | (csd[8] << 8) | csd[9]) + 1;
+        return size << 10;
+    } else {
+        //Calculate the sector count for a standard capacity card
+        unsigned int size = (((csd[6] & 0x03) << 10) | (csd[7] << 2) | ((csd[8] & 0xC0) >> 6)) + 1;
+        size <<= ((((csd[9] & 0x03) << 1) | ((csd[10] & 0x80) >> 7)) + 2);
+        size <<= (csd[5] & 0x0F);
+        return size >> 9;
+    }
+}
+
+//Calculates the erase unit size in sectors from a CSD register
+uint32_t csdEraseSectors(const char* csd, bool mmc)
+{
+    //Get the write block length in sectors (at least 1)
+    unsigned int blockLength = ((csd[12] & 0x03) << 2) | (csd[13] >> 6);
+    unsigned int blockSectors = (blockLength > 9) ? (1 << (blockLength - 9)) : 1;
+
+    if (mmc) {
+        //Calculate the erase group size for an MMC card
+        unsigned int size = ((csd[10] & 0x7C) >> 2) + 1;
+        unsigned int mult = (((csd[10] & 0x03) << 3) | (csd[11] >> 5)) + 1;
+        return size * mult * blockSectors;
+    } else if (csd[10] & 0x40) {
+        //Single blocks can be erased (always the case for high capacity cards)
+        return 1;
+    } else {
+        //Calculate the erase sector size for a standard capacity card
+        unsigned int size = (((csd[10] & 0x3F) << 1) | (csd[11] >> 7)) + 1;
+        return size * blockSectors;
+    }
+}
+
+//Calculates the allocation unit size in sectors from an SD status register
+uint32_t statusAuSectors(const char* status)
+{
+    //Allocation units from 16kB to 4MB are powers of 2, and the rest are listed in the SD specification
+    static const uint32_t largeSizes[6] = { 16384, 24576, 32768, 49152, 65536, 131072 };
+    unsigned int code = (unsigned char)status[10] >> 4;
+    if (code == 0)
+        return 0;
+    else if (code < 10)
+        return 32 << (code - 1);
+    else
+        return largeSizes[code - 10];
+}
+
+//Converts the speed class code from an SD status register
+int statusSpeedClass(const char* status)
+{
+    static const int classes[5] = { 0, 2, 4, 6, 10 };
+    unsigned int code = (unsigned char)status[8];
+    return (code < 5) ? classes[code] : -1;
+}
+
+//Determines whether or not a buffer can be handed to the transport's block transfers
+inline bool wordAligned(const void* buffer)
+{
+    return !((uintptr_t)buffer & 0x3);
+}
+
+//Checksum sidecar header layout
+const uint32_t SIDECAR_MAGIC = 0x4B434453;  /**< "SDCK" */
+const unsigned int NO_TABLE = 0xFFFFFFFF;
+
+//Stores a 32-bit little endian value
+void putWord(char* buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+//Loads a 32-bit little endian value
+uint32_t getWord(const char* buffer)
+{
+    return (uint32_t)(unsigned char)buffer[0] | ((uint32_t)(unsigned char)buffer[1] << 8) | ((uint32_t)(unsigned char)buffer[2] << 16) | ((uint32_t)(unsigned char)buffer[3] << 24);
+}
+
+//Stores a 16-bit little endian value
+void putHalf(char* buffer, unsigned short value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+}
+
+//Loads a 16-bit little endian value
+unsigned short getHalf(const char* buffer)
+{
+    return (unsigned short)((unsigned char)buffer[0] | ((unsigned char)buffer[1] << 8));
+}
+
+//Returns the number of data sectors left on a card once its checksum sidecar (1 table sector per 256 sectors, and a header) is reserved
+inline uint32_t sidecarData(uint32_t sectors)
+{
+    uint32_t tables = (sectors - 1 + 256) / 257;
+    return sectors - 1 - tables;
+}
+
+//Calculates the sidecar checksum of a sector, keeping clear of the erased values (0x0000 and 0xFFFF mean no checksum)
+inline unsigned short sectorChecksum(const char* buffer)
+{
+    unsigned short crc = SDCRC::crc16(buffer, 512);
+    if (crc == 0x0000)
+        return 0x0001;
+    else if (crc == 0xFFFF)
+        return 0xFFFE;
+    else
+        return crc;
+}
+}
+
+SDDisk::SDDisk(PinName mosi, PinName miso, PinName sclk, PinName cs, PinName cd, SwitchType cdtype, int hz)
+    : m_Cd(cd),
+      m_Freq(hz)
+{
+    //Create the SPI transport
+    m_OwnedTransport = new SDSpiTransport(mosi, miso, sclk, cs);
+    m_Spi = m_OwnedTransport;
+    m_Native = NULL;
+    init(cdtype);
+}
+
+SDDisk::SDDisk(SDSharedBus& bus, PinName cs, PinName cd, SwitchType cdtype, int hz)
+    : m_Cd(cd),
+      m_Freq(hz)
+{
+    //Create an SPI transport on the shared bus
+    m_OwnedTransport = new SDSpiTransport(bus, cs);
+    m_Spi = m_OwnedTransport;
+    m_Native = NULL;
+    init(cdtype);
+}
+
+SDDisk::SDDisk(SDTransport& transport, PinName cd, SwitchType cdtype, int hz)
+    : m_Cd(cd),
+      m_Freq(hz)
+{
+    //Use the caller's transport
+    m_OwnedTransport = NULL;
+    m_Spi = &transport;
+    m_Native = NULL;
+    init(cdtype);
+}
+
+SDDisk::SDDisk(SDNativeTransport& transport, PinName cd, SwitchType cdtype, int hz)
+    : m_Cd(cd),
+      m_Freq(hz)
+{
+    //Use the caller's native transport
+    m_OwnedTransport = NULL;
+    m_Spi = NULL;
+    m_Native = &transport;
+    init(cdtype);
+}
+
+SDDisk::~SDDisk()
+{
+#if SD_USE_RTOS
+    //Stop the write ring flusher thread
+    stopRing();
+
+    //Stop the checksum scrubber thread
+    stopScrubber();
+#endif
+
+    //Release the write gather, read-ahead, checksum and clock tuning buffers, the power switch, and the SPI transport if we created it
+    delete[] m_GatherBuffer;
+    delete[] m_AheadBuffer;
+    delete[] m_SidecarBuffer;
+    delete[] m_ScrubBuffer;
+    delete[] m_TuneBuffer;
+    delete m_Power;
+    delete m_OwnedTransport;
+}
+
+void SDDisk::init(SwitchType cdtype)
+{
+    //Initialize the member variables
+    m_CardType = CARD_NONE;
+    m_Crc = (SD_FIXED_CRC != 0);
+    m_LargeFrames = (SD_FIXED_LARGE_FRAMES > 0);
+    m_BusFreq = 0;
+    m_HighSpeed = false;
+    m_ClockTuning = false;
+    memset(&m_Identity, 0, sizeof(m_Identity));
+    m_Identity.type = CARD_NONE;
+    m_Recognized = false;
+    memset(&m_Info, 0, sizeof(m_Info));
+    m_TuneBlocks = 0;
+    m_TuneErrors = 0;
+    m_Recovery.retries = 3;
+    m_Recovery.window = 256;
+    m_Recovery.error_ratio = 64;
+    m_Recovery.step_clock = false;
+    m_Recovery.shrink_bursts = false;
+    m_Recovery.clean_sectors = 4096;
+    m_Recovery.min_frequency = 400000;
+    reset_recovery_stats();
+    m_ClockSteps = 0;
+    m_ClockCeiling = 0;
+    m_BurstSteps = 0;
+    m_CleanBlocks = 0;
+    m_TuneBuffer = NULL;
+    m_CrcSampling = 1;
+    m_CrcSampleCount = 0;
+    m_ValidationMode = (SD_FIXED_VALIDATION < 0) ? VALIDATE_EACH : (ValidationMode)SD_FIXED_VALIDATION;
+    m_ValidationInterval = 8;
+    m_PendingValidations = 0;
+    m_ValidationError = false;
+    m_Status = STA_NOINIT;
+    m_CardRemoved = false;
+#if DEVICE_SPI_ASYNCH
+    m_Dma = true;
+#else
+    m_Dma = false;
+#endif
+    m_WaitMode = WAIT_SPIN;
+    m_WaitMaxDelay = 1000;
+    reset_wait_stats();
+    m_WriteStreaming = false;
+    m_AuAlignment = false;
+    m_CommandBatching = true;
+    m_StreamOpen = false;
+    m_StreamLba = 0;
+    m_AsyncHead = 0;
+    m_AsyncTail = 0;
+    m_AsyncState = ASYNC_IDLE;
+    m_GatherBuffer = NULL;
+    m_GatherSize = 0;
+    m_GatherLba = 0;
+    m_GatherCount = 0;
+    m_GatherTimeout = 100;
+    m_AheadBuffer = NULL;
+    m_AheadSize = 0;
+    m_AheadLba = 0;
+    m_AheadCount = 0;
+    m_AheadDepth = 0;
+    m_AheadNext = 0;
+    m_RingError = false;
+    reset_ring_stats();
+    m_IdleTimeout = 0;
+    m_Suspended = false;
+    m_IdleError = false;
+    m_PoweredOff = false;
+    m_Power = NULL;
+    m_PowerOn = 1;
+    m_PowerRamp = 5;
+    reset_idle_stats();
+    m_Checksums = false;
+    m_SidecarActive = false;
+    m_SidecarData = 0;
+    m_SidecarBuffer = NULL;
+    m_SidecarTable = NO_TABLE;
+    m_SidecarDirty = false;
+    m_ScrubBuffer = NULL;
+    m_ScrubTable = NO_TABLE;
+    m_ScrubNext = 0;
+    reset_scrub_stats();
+#if SD_USE_RTOS
+    m_RingThread = NULL;
+    m_RingStop = false;
+    m_ScrubThread = NULL;
+    m_ScrubStop = false;
+    m_ScrubInterval = 0;
+    m_ScrubCount = 0;
+#endif
+
+    //Configure the SPI bus for 8-bit frames
+    if (m_Spi != NULL)
+        m_Spi->format(8);
+
+    //Configure the card detect pin
+    if (cdtype == SWITCH_POS_NO) {
+        m_Cd.mode(PullDown);
+        m_CdAssert = 1;
+        m_Cd.fall(this, &SDDisk::onCardRemoval);
+    } else if (cdtype == SWITCH_POS_NC) {
+        m_Cd.mode(PullDown);
+        m_CdAssert = 0;
+        m_Cd.rise(this, &SDDisk::onCardRemoval);
+    } else if (cdtype == SWITCH_NEG_NO) {
+        m_Cd.mode(PullUp);
+        m_CdAssert = 0;
+        m_Cd.rise(this, &SDDisk::onCardRemoval);
+    } else if (cdtype == SWITCH_NEG_NC) {
+        m_Cd.mode(PullUp);
+        m_CdAssert = 1;
+        m_Cd.fall(this, &SDDisk::onCardRemoval);
+    } else {
+        m_CdAssert = -1;
+    }
+}
+
+bool SDDisk::card_present()
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Check the card socket
+    checkSocket();
+
+    //Return whether or not a card is present
+    return !(m_Status & STA_NODISK);
+}
+
+SDDisk::CardType SDDisk::card_type()
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Check the card socket
+    checkSocket();
+
+    //Return the card type
+    return m_CardType;
+}
+
+SDDisk::CardIdentity SDDisk::card_identity()
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Return the identity of the last card initialized
+    return m_Identity;
+}
+
+void SDDisk::card_identity(const SDDisk::CardIdentity& identity)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Remember the identity for the next initialization
+    m_Identity = identity;
+}
+
+SDDisk::CardInfo SDDisk::card_info()
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Return the card geometry
+    return m_Info;
+}
+
+int SDDisk::frequency()
+{
+    //Return the requested SPI bus frequency
+    return m_Freq;
+}
+
+void SDDisk::frequency(int hz)
+{
+    //Set the requested SPI bus frequency for the next initialization
+    m_Freq = hz;
+}
+
+int SDDisk::bus_frequency()
+{
+    //Return the SPI bus frequency in use
+    return m_BusFreq;
+}
+
+bool SDDisk::high_speed()
+{
+    //Return whether or not high speed mode is enabled
+    return m_HighSpeed;
+}
+
+bool SDDisk::clock_tuning()
+{
+    //Return whether or not clock tuning is enabled
+    return m_ClockTuning;
+}
+
+void SDDisk::clock_tuning(bool enabled)
+{
+    //Set whether or not clock tuning is enabled
+    m_ClockTuning = enabled;
+}
+
+SDDisk::RecoveryPolicy SDDisk::recovery_policy()
+{
+    //Return the error recovery policy
+    return m_Recovery;
+}
+
+void SDDisk::recovery_policy(const SDDisk::RecoveryPolicy& policy)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Set the error recovery policy, keeping the counts and the frequency in range
+    m_Recovery = policy;
+    if (m_Recovery.retries < 1)
+        m_Recovery.retries = 1;
+    if (m_Recovery.window < 1)
+        m_Recovery.window = 1;
+    if (m_Recovery.error_ratio < 1)
+        m_Recovery.error_ratio = 1;
+    if (m_Recovery.clean_sectors < 0)
+        m_Recovery.clean_sectors = 0;
+    if (m_Recovery.min_frequency < 100000)
+        m_Recovery.min_frequency = 100000;
+}
+
+SDDisk::RecoveryStats SDDisk::recovery_stats()
+{
+    //Return the error recovery statistics
+    return m_RecoveryStats;
+}
+
+void SDDisk::reset_recovery_stats()
+{
+    //Clear the error recovery statistics
+    memset(&m_RecoveryStats, 0, sizeof(m_RecoveryStats));
+    m_RecoveryStats.last = RETRY_NONE;
+}
+
+bool SDDisk::crc()
+{
+    //Return whether or not CRC is enabled
+    return crcEnabled();
+}
+
+void SDDisk::crc(bool enabled)
+{
+    //Ignore the request if CRC is fixed at compile time
+    if (SD_FIXED_CRC >= 0)
+        return;
+
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Check the card socket
+    checkSocket();
+
+    //Just update the member variable if the card isn't initialized or is switched off, or the host controller handles checksums
+    if ((m_Status & STA_NOINIT) || m_PoweredOff || m_Native != NULL) {
+        m_Crc = enabled;
+        return;
+    }
+
+    //Finalize any open multiple block write session
+    closeStream();
+
+    //Enable or disable CRC
+    if (enabled && !m_Crc) {
+        //Send CMD59(0x00000001) to enable CRC
+        m_Crc = true;
+        commandTransaction(CMD59, 0x00000001);
+    } else if (!enabled && m_Crc) {
+        //Send CMD59(0x00000000) to disable CRC
+        commandTransaction(CMD59, 0x00000000);
+        m_Crc = false;
+    }
+}
+
+int SDDisk::crc_sampling()
+{
+    //Return the number of data blocks per CRC16 check
+    return m_CrcSampling;
+}
+
+void SDDisk::crc_sampling(int interval)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Check at least every block, and restart the count
+    m_CrcSampling = (interval > 1) ? interval : 1;
+    m_CrcSampleCount = 0;
+}
+
+bool SDDisk::large_frames()
+{
+    //Return whether or not 16-bit frames are enabled
+    return largeFrames();
+}
+
+void SDDisk::large_frames(bool enabled)
+{
+    //Set whether or not 16-bit frames are enabled, unless they're fixed at compile time
+    if (SD_FIXED_LARGE_FRAMES < 0)
+        m_LargeFrames = enabled;
+}
+
+bool SDDisk::write_validation()
+{
+    //Return whether or not write validation is enabled
+    return (validationMode() != VALIDATE_NONE);
+}
+
+void SDDisk::write_validation(bool enabled)
+{
+    //Set whether or not write validation is enabled
+    validation_mode(enabled ? VALIDATE_EACH : VALIDATE_NONE);
+}
+
+SDDisk::ValidationMode SDDisk::validation_mode()
+{
+    //Return the write validation policy
+    return validationMode();
+}
+
+void SDDisk::validation_mode(SDDisk::ValidationMode mode, int interval)
+{
+    //Set the write validation policy, unless it's fixed at compile time
+    if (SD_FIXED_VALIDATION < 0)
+        m_ValidationMode = mode;
+    m_ValidationInterval = (interval > 0) ? interval : 1;
+}
+
+bool SDDisk::dma()
+{
+    //Return whether or not DMA is enabled
+    return m_Dma;
+}
+
+void SDDisk::dma(bool enabled)
+{
+#if DEVICE_SPI_ASYNCH
+    //Set whether or not DMA is enabled
+    m_Dma = enabled;
+#endif
+}
+
+SDDisk::WaitMode SDDisk::wait_mode()
+{
+    //Return the wait mode
+    return m_WaitMode;
+}
+
+void SDDisk::wait_mode(SDDisk::WaitMode mode, int max_delay_us)
+{
+    //Set the wait mode
+    m_WaitMode = mode;
+    m_WaitMaxDelay = (max_delay_us > 0) ? max_delay_us : 1;
+}
+
+SDDisk::WaitStats SDDisk::busy_wait_stats()
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Return the busy wait timing
+    return m_BusyWaits;
+}
+
+SDDisk::WaitStats SDDisk::token_wait_stats()
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Return the token wait timing
+    return m_TokenWaits;
+}
+
+void SDDisk::reset_wait_stats()
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Clear the accumulated wait timing
+    memset(&m_BusyWaits, 0, sizeof(m_BusyWaits));
+    memset(&m_TokenWaits, 0, sizeof(m_TokenWaits));
+}
+
+#if SD_ENABLE_STATS
+const SDStats& SDDisk::stats()
+{
+    //Return the performance counters
+    return m_Stats;
+}
+
+void SDDisk::reset_stats()
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Clear the performance counters
+    m_Stats.reset();
+}
+#endif
+
+int SDDisk::cache_size()
+{
+    //Return the number of cached sectors
+    return m_Cache.size();
+}
+
+void SDDisk::cache_size(int sectors)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Write back any dirty sectors before the cache is resized
+    if (!(m_Status & STA_NOINIT))
+        flushCache();
+
+    //Resize the cache
+    m_Cache.resize(sectors);
+}
+
+int SDDisk::write_gather()
+{
+    //Return the size of the write gather buffer
+    return m_GatherSize;
+}
+
+void SDDisk::write_gather(int sectors)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Write any gathered sectors before the buffer is resized
+    if (!(m_Status & STA_NOINIT))
+        flushGather();
+    m_GatherCount = 0;
+
+    //Resize the write gather buffer
+    delete[] m_GatherBuffer;
+    m_GatherBuffer = (sectors > 0) ? new char[sectors * 512] : NULL;
+    m_GatherSize = (m_GatherBuffer != NULL) ? sectors : 0;
+}
+
+int SDDisk::write_gather_timeout()
+{
+    //Return the maximum age of gathered writes
+    return m_GatherTimeout;
+}
+
+void SDDisk::write_gather_timeout(int ms)
+{
+    //Set the maximum age of gathered writes
+    m_GatherTimeout = ms;
+}
+
+int SDDisk::write_ring()
+{
+    //Return the size of the write ring
+    return m_Ring.size();
+}
+
+void SDDisk::write_ring(int sectors)
+{
+    //Keep disk_write() out while the ring is resized
+    SDScopedLock ringLock(m_RingMutex);
+
+#if SD_USE_RTOS
+    //Stop the flusher thread before taking the card, since it may be waiting for it
+    stopRing();
+#endif
+
+    {
+        //Serialize access to the card
+        SDScopedLock lock(m_Mutex);
+
+        //Write any queued sectors before the ring is resized
+        drainRing(m_Ring.count());
+        m_Ring.resize(sectors);
+    }
+
+#if SD_USE_RTOS
+    //Start a flusher thread for the new ring
+    if (m_Ring.size() > 0) {
+        m_RingStop = false;
+        m_RingThread = new Thread(osPriorityNormal, SD_RING_STACK_SIZE);
+        m_RingThread->start(callback(this, &SDDisk::ringTask));
+    }
+#endif
+}
+
+SDDisk::RingStats SDDisk::ring_stats()
+{
+    //Return the write ring statistics
+    return m_RingStats;
+}
+
+void SDDisk::reset_ring_stats()
+{
+    //Clear the write ring statistics
+    memset(&m_RingStats, 0, sizeof(m_RingStats));
+}
+
+bool SDDisk::write_streaming()
+{
+    //Return whether or not write streaming is enabled
+    return m_WriteStreaming;
+}
+
+void SDDisk::write_streaming(bool enabled)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Finalize any open multiple block write session if streaming is being disabled
+    if (!enabled && !(m_Status & STA_NOINIT)) {
+        flushGather();
+        closeStream();
+    }
+
+    //Set whether or not write streaming is enabled
+    m_WriteStreaming = enabled;
+}
+
+bool SDDisk::au_alignment()
+{
+    //Return whether or not writes are aligned to allocation unit boundaries
+    return m_AuAlignment;
+}
+
+void SDDisk::au_alignment(bool enabled)
+{
+    //Set whether or not writes are aligned to allocation unit boundaries
+    m_AuAlignment = enabled;
+}
+
+bool SDDisk::command_batching()
+{
+    //Return whether or not back-to-back commands are batched
+    return m_CommandBatching;
+}
+
+void SDDisk::command_batching(bool enabled)
+{
+    //Set whether or not back-to-back commands are batched
+    m_CommandBatching = enabled;
+}
+
+int SDDisk::idle_timeout()
+{
+    //Return the idle timeout
+    return m_IdleTimeout;
+}
+
+void SDDisk::idle_timeout(int ms)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Set the idle timeout, and start timing from now
+    m_IdleTimeout = (ms > 0) ? ms : 0;
+    m_IdleTimer.reset();
+    m_IdleTimer.start();
+}
+
+void SDDisk::power_pin(PinName pin, bool active_high, int ramp_ms)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Replace any previous power switch, powering the card unless it's been switched off while suspended
+    delete m_Power;
+    m_PowerOn = active_high ? 1 : 0;
+    m_PowerRamp = (ramp_ms > 0) ? ramp_ms : 0;
+    m_Power = new DigitalOut(pin, m_PoweredOff ? !m_PowerOn : m_PowerOn);
+}
+
+int SDDisk::suspend()
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Make sure the card is initialized before proceeding
+    if (m_Status & STA_NOINIT)
+        return RES_NOTRDY;
+
+    //Write everything back, and wait for the card to finish programming
+    int res = disk_sync();
+    if (res != RES_OK)
+        return res;
+
+    //Suspend the card
+    powerDown();
+    return RES_OK;
+}
+
+bool SDDisk::suspended()
+{
+    //Return whether or not the card is suspended
+    return m_Suspended;
+}
+
+SDDisk::IdleStats SDDisk::idle_stats()
+{
+    //Return the idle management statistics
+    return m_IdleStats;
+}
+
+void SDDisk::reset_idle_stats()
+{
+    //Clear the idle management statistics
+    memset(&m_IdleStats, 0, sizeof(m_IdleStats));
+}
+
+bool SDDisk::checksums()
+{
+    //Return whether or not the checksum sidecar is used
+    return m_Checksums;
+}
+
+void SDDisk::checksums(bool enabled)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Just update the member variable, the sidecar is opened during initialization
+    m_Checksums = enabled;
+}
+
+int SDDisk::format_checksums()
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Make sure the card is initialized before proceeding
+    if (m_Status & STA_NOINIT)
+        return RES_NOTRDY;
+
+    //Make sure the card isn't write protected before proceeding
+    if (m_Status & STA_PROTECT)
+        return RES_WRPRT;
+
+    //Make sure there's room for a sidecar
+    if (m_Info.sectors < 2)
+        return RES_PARERR;
+
+    //Write everything back, and wake the card if it's suspended
+    int res = disk_sync();
+    if (res != RES_OK)
+        return res;
+    if (!resumeCard())
+        return RES_ERROR;
+
+    //Stop using any existing sidecar
+    m_SidecarActive = false;
+    m_SidecarTable = NO_TABLE;
+    m_SidecarDirty = false;
+    m_ScrubTable = NO_TABLE;
+    if (m_SidecarBuffer == NULL)
+        m_SidecarBuffer = new char[512];
+
+    //Discard any cached or prefetched copies of the sidecar region
+    uint32_t data = sidecarData(m_Info.sectors);
+    uint32_t tables = m_Info.sectors - 1 - data;
+    m_Cache.discard(data, tables + 1);
+    m_AheadCount = 0;
+
+    //Clear the tables so every sector starts out with no checksum (by writing them if single sectors can't be erased)
+    bool success;
+    if (m_Info.erase_sectors == 1) {
+        success = eraseBlocks(data, tables);
+    } else {
+        memset(m_SidecarBuffer, 0, 512);
+        success = true;
+        for (uint32_t i = 0; success && i < tables; i++)
+            success = cardWrite(m_SidecarBuffer, data + i, 1);
+    }
+
+    //Write the header to the last sector
+    memset(m_SidecarBuffer, 0, 512);
+    putWord(m_SidecarBuffer, SIDECAR_MAGIC);
+    putWord(m_SidecarBuffer + 4, data);
+    putHalf(m_SidecarBuffer + 8, SDCRC::crc16(m_SidecarBuffer, 8));
+    if (!success || !cardWrite(m_SidecarBuffer, m_Info.sectors - 1, 1) || !closeStream())
+        return RES_ERROR;
+
+    //Start using the sidecar
+    m_Checksums = true;
+    m_SidecarActive = true;
+    m_SidecarData = data;
+    m_ScrubNext = 0;
+    return RES_OK;
+}
+
+int SDDisk::scrub(uint32_t count)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Make sure the card is initialized and has a sidecar before proceeding
+    if ((m_Status & STA_NOINIT) || !m_SidecarActive)
+        return -1;
+
+    //Wake the card if it's suspended
+    if (!resumeCard())
+        return -1;
+
+    //Verify the sectors
+    return scrubSectors(count);
+}
+
+void SDDisk::scrubber(int interval_ms, int sectors)
+{
+#if SD_USE_RTOS
+    //Stop the scrubber thread before changing its settings
+    stopScrubber();
+
+    //Start a new scrubber thread if requested
+    if (interval_ms > 0 && sectors > 0) {
+        m_ScrubInterval = interval_ms;
+        m_ScrubCount = sectors;
+        m_ScrubStop = false;
+        m_ScrubThread = new Thread(osPriorityLow, SD_SCRUB_STACK_SIZE);
+        m_ScrubThread->start(callback(this, &SDDisk::scrubTask));
+    }
+#else
+    //There's no background scrubbing without the RTOS
+    (void)interval_ms;
+    (void)sectors;
+#endif
+}
+
+SDDisk::ScrubStats SDDisk::scrub_stats()
+{
+    //Return the checksum scrubber statistics
+    return m_ScrubStats;
+}
+
+void SDDisk::reset_scrub_stats()
+{
+    //Clear the checksum scrubber statistics
+    memset(&m_ScrubStats, 0, sizeof(m_ScrubStats));
+}
+
+int SDDisk::erase(uint32_t sector, uint32_t count)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Make sure the card is initialized before proceeding
+    if (m_Status & STA_NOINIT)
+        return RES_NOTRDY;
+
+    //Make sure the card isn't write protected before proceeding
+    if (m_Status & STA_PROTECT)
+        return RES_WRPRT;
+
+    //Make sure the range is on the card
+    uint32_t sectors = m_SidecarActive ? m_SidecarData : m_Info.sectors;
+    if (count == 0)
+        return RES_OK;
+    if (sector >= sectors || count > sectors - sector)
+        return RES_PARERR;
+
+    //Wake the card if it's suspended
+    if (!resumeCard())
+        return RES_ERROR;
+
+    //Write any queued or gathered sectors the range overlaps first, so the erase lands after them
+    if (m_Ring.overlaps(sector, count) && !drainRing(m_Ring.count()))
+        return RES_ERROR;
+    if (gatherOverlaps(sector, count) && !flushGather())
+        return RES_ERROR;
+
+    //Finalize any open multiple block write session
+    if (!closeStream())
+        return RES_ERROR;
+
+    //Discard any cached or prefetched copies of the sectors, dirty or not
+    m_Cache.discard(sector, count);
+    m_AheadCount = 0;
+
+    //Forget the sectors' checksums, since they'll read back as 0x00 or 0xFF
+    if (!setChecksums(NULL, sector, count))
+        return RES_ERROR;
+
+    //Erase the sectors
+    return eraseBlocks(sector, count) ? RES_OK : RES_ERROR;
+}
+
+int SDDisk::disk_trim(uint32_t sector, uint32_t count)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Make sure the card is initialized before proceeding
+    if (m_Status & STA_NOINIT)
+        return RES_NOTRDY;
+
+    //Only erase whole allocation units (or erase units), since erasing part of one gains nothing
+    uint32_t unit = (m_Info.au_sectors > 0) ? m_Info.au_sectors : m_Info.erase_sectors;
+    if (unit == 0)
+        unit = 1;
+    uint32_t first = sector + (unit - (sector % unit)) % unit;
+    uint32_t last = (sector + count) - ((sector + count) % unit);
+    if (count == 0 || last <= first)
+        return RES_OK;
+
+    //Erase the units ahead of time, the data in them is no longer needed
+    return erase(first, last - first);
+}
+
+int SDDisk::read_ahead()
+{
+    //Return the size of the read-ahead buffer
+    return m_AheadSize;
+}
+
+void SDDisk::read_ahead(int sectors)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Discard any prefetched sectors, and reset the sequential access detection
+    m_AheadCount = 0;
+    m_AheadDepth = 0;
+
+    //Resize the read-ahead buffer
+    delete[] m_AheadBuffer;
+    m_AheadBuffer = (sectors > 0) ? new char[sectors * 512] : NULL;
+    m_AheadSize = (m_AheadBuffer != NULL) ? sectors : 0;
+}
+
+bool SDDisk::read_async(uint8_t* buffer, uint32_t sector, uint32_t count, Callback<void(int)> callback)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Make sure the card is initialized before proceeding
+    if (m_Status & STA_NOINIT)
+        return false;
+
+    //Queue the read request
+    return queueAsync(ASYNC_READ, buffer, sector, count, callback);
+}
+
+bool SDDisk::write_async(const uint8_t* buffer, uint32_t sector, uint32_t count, Callback<void(int)> callback)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Make sure the card is initialized before proceeding
+    if (m_Status & STA_NOINIT)
+        return false;
+
+    //Make sure the card isn't write protected before proceeding
+    if (m_Status & STA_PROTECT)
+        return false;
+
+    //Queue the write request
+    return queueAsync(ASYNC_WRITE, (uint8_t*)buffer, sector, count, callback);
+}
+
+bool SDDisk::sync_async(Callback<void(int)> callback)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Queue the sync request
+    return queueAsync(ASYNC_SYNC, NULL, 0, 0, callback);
+}
+
+bool SDDisk::async_poll()
+{
+    //Don't wait for another thread's transaction to finish, just report that we're still busy
+    if (!m_Mutex.trylock())
+        return true;
+
+    //Advance the state machine
+    bool busy = stepAsync();
+    m_Mutex.unlock();
+    return busy;
+}
+
+bool SDDisk::stepAsync()
+{
+    //Start the next request if we're idle
+    if (m_AsyncState == ASYNC_IDLE) {
+        //Get out if there's nothing to do, writing any gathered sectors that have expired, and suspending an idle card
+        if (m_AsyncTail == m_AsyncHead) {
+            checkGather();
+            checkIdle();
+            return false;
+        }
+
+        //Wake the card if it's suspended
+        if (!resumeCard()) {
+            finishAsync(RES_ERROR);
+            return (m_AsyncTail != m_AsyncHead);
+        }
+
+        //Write any gathered sectors the request overlaps so it sees a coherent card, and finalize any open write session
+        AsyncRequest& next = m_AsyncQueue[m_AsyncTail];
+        if (next.op != ASYNC_SYNC && m_Ring.overlaps(next.sector, next.count) && !drainRing(m_Ring.count())) {
+            finishAsync(RES_ERROR);
+            return (m_AsyncTail != m_AsyncHead);
+        }
+        if (next.op != ASYNC_SYNC && gatherOverlaps(next.sector, next.count) && !flushGather()) {
+            finishAsync(RES_ERROR);
+            return (m_AsyncTail != m_AsyncHead);
+        }
+        if (!closeStream()) {
+            finishAsync(RES_ERROR);
+            return (m_AsyncTail != m_AsyncHead);
+        }
+
+        //Wait for the card to become ready before the first transfer
+        m_AsyncTimer.reset();
+        m_AsyncTimer.start();
+        m_AsyncState = ASYNC_WAIT_READY;
+    }
+
+    AsyncRequest& request = m_AsyncQueue[m_AsyncTail];
+
+    if (m_AsyncState == ASYNC_WAIT_READY || m_AsyncState == ASYNC_VALIDATE) {
+        //Check if the card is still busy without waiting for it
+        if (!pollReady()) {
+            //Give up if the card has been busy for more than 500ms
+            if (m_AsyncTimer.read_ms() >= 500)
+                finishAsync(RES_ERROR);
+        } else if (m_AsyncState == ASYNC_VALIDATE && !validateWrite()) {
+            //Some manner of unrecoverable write error occured during programming
+            finishAsync(RES_ERROR);
+        } else if (request.op == ASYNC_SYNC) {
+            //Report any errors found by deferred write validation
+            finishAsync(finishValidation() ? RES_OK : RES_ERROR);
+        } else if (request.count == 0 && request.op == ASYNC_WRITE && m_StreamOpen) {
+            //Send the stop tran token to finalize the request's write session, and let the card finish programming
+            m_StreamOpen = false;
+            if (!select()) {
+                finishAsync(RES_ERROR);
+            } else {
+                m_Spi->write(0xFD);
+                deselect();
+
+                //Validate the session once it's programmed, or finish now and let the next request wait for busy (deferred checks run on sync)
+                m_AsyncTimer.reset();
+                m_AsyncState = (validationMode() == VALIDATE_EACH) ? ASYNC_VALIDATE : ASYNC_WAIT_READY;
+                if (validationMode() == VALIDATE_ON_SYNC || validationMode() == VALIDATE_EVERY_N)
+                    m_PendingValidations++;
+                if (m_AsyncState == ASYNC_WAIT_READY)
+                    finishAsync(RES_OK);
+            }
+        } else if (request.count == 0) {
+            //There's nothing left to transfer
+            finishAsync(RES_OK);
+        } else if (m_Status & STA_NOINIT) {
+            //The card was removed or deinitialized since the request was queued
+            finishAsync(RES_NOTRDY);
+        } else {
+            //The card is ready for the next sector
+            m_AsyncState = ASYNC_TRANSFER;
+        }
+    } else if (m_AsyncState == ASYNC_TRANSFER) {
+        //Transfer the next sector, keeping the sector cache coherent (multiple sector writes over SPI share one CMD25 session)
+        bool success;
+        bool session = (request.op == ASYNC_WRITE && m_Native == NULL && (request.count > 1 || (m_StreamOpen && request.sector == m_StreamLba)));
+        int slot = m_Cache.find(request.sector);
+        if (request.op == ASYNC_READ) {
+            if (slot >= 0) {
+                memcpy(request.buffer, m_Cache.data(slot), 512);
+                success = true;
+            } else {
+                success = readBlock((char*)request.buffer, request.sector);
+            }
+        } else {
+            success = setChecksums((const char*)request.buffer, request.sector, 1);
+            if (success)
+                success = session ? sessionWrite((const char*)request.buffer, request.sector, request.count) : writeBlock((const char*)request.buffer, request.sector, false);
+            m_AheadCount = 0;
+            if (success && slot >= 0) {
+                memcpy(m_Cache.data(slot), request.buffer, 512);
+                m_Cache.clean(slot);
+            }
+        }
+
+        if (success) {
+            //Update the variables
+            request.buffer += 512;
+            request.sector++;
+            request.count--;
+
+            if (session) {
+                //Let the card finish programming the block before writing the next one, or finalizing the session
+                m_AsyncTimer.reset();
+                m_AsyncState = ASYNC_WAIT_READY;
+            } else if (request.op == ASYNC_WRITE) {
+                //Let the card finish programming before validating or writing the next sector (deferred checks run on sync)
+                m_AsyncTimer.reset();
+                m_AsyncState = (validationMode() == VALIDATE_EACH) ? ASYNC_VALIDATE : ASYNC_WAIT_READY;
+                if (validationMode() == VALIDATE_ON_SYNC || validationMode() == VALIDATE_EVERY_N)
+                    m_PendingValidations++;
+                if (m_AsyncState == ASYNC_WAIT_READY && request.count == 0)
+                    finishAsync(RES_OK);
+            } else if (request.count == 0) {
+                //The read is complete
+                finishAsync(RES_OK);
+            }
+        } else {
+            //The transfer failed
+            finishAsync(RES_ERROR);
+        }
+    }
+
+    //Return whether or not there's still work to do
+    return (m_AsyncState != ASYNC_IDLE || m_AsyncTail != m_AsyncHead);
+}
+
+int SDDisk::disk_deinitialize()
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Write any queued, dirty and gathered sectors, and finalize any open write session
+    drainRing(m_Ring.count());
+    if (!(m_Status & STA_NOINIT)) {
+        flushCache();
+        flushGather();
+        flushChecksums();
+        closeStream();
+    }
+
+    //Change the status to not initialized, and the card type to unknown (a switched off card stays off until disk_initialize())
+    m_Status |= STA_NOINIT;
+    m_CardType = CARD_UNKNOWN;
+    m_Suspended = false;
+
+    //Always succeeds
+    return 0;
+}
+
+int SDDisk::disk_initialize()
+{
+    char token;
+    unsigned int resp;
+    Timer timer;
+
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Make sure there's a card in the socket before proceeding
+    checkSocket();
+    if (m_Status & STA_NODISK)
+        return m_Status;
+
+    //Make sure we're not already initialized before proceeding
+    if (!(m_Status & STA_NOINIT))
+        return m_Status;
+
+    //Switch the card back on if it was switched off while suspended, and let the supply settle
+    m_Suspended = false;
+    if (m_PoweredOff) {
+        m_Power->write(m_PowerOn);
+        m_PoweredOff = false;
+#if SD_USE_RTOS
+        Thread::wait(m_PowerRamp);
+#else
+        wait_ms(m_PowerRamp);
+#endif
+    }
+
+    //Discard anything cached or gathered from a previous card
+    m_Cache.clear();
+    m_GatherCount = 0;
+    m_AheadCount = 0;
+    m_AheadDepth = 0;
+    m_StreamOpen = false;
+    m_PendingValidations = 0;
+    m_ValidationError = false;
+    m_BusFreq = 0;
+    m_HighSpeed = false;
+    m_Recognized = false;
+    memset(&m_Info, 0, sizeof(m_Info));
+    m_ClockSteps = 0;
+    m_BurstSteps = 0;
+    m_CleanBlocks = 0;
+
+    //Let a native transport run its own identification sequence
+    if (m_Native != NULL) {
+        bool highCapacity;
+        if (!m_Native->initialize(m_Freq, &highCapacity)) {
+            //Initialization failed
+            m_CardType = CARD_UNKNOWN;
+            return m_Status;
+        }
+
+        //Read the card geometry from the CSD register (the SD status isn't available through the transport)
+        char csd[16];
+        if (!m_Native->read_csd(csd)) {
+            //Initialization failed
+            m_CardType = CARD_UNKNOWN;
+            return m_Status;
+        }
+        m_Info.sectors = csdSectors(csd);
+        m_Info.erase_sectors = csdEraseSectors(csd, false);
+        m_Info.speed_class = -1;
+
+        //Reject byte addressed cards if they aren't supported
+        if (SD_SDHC_ONLY && !highCapacity) {
+            //Initialization failed
+            m_CardType = CARD_UNKNOWN;
+            return m_Status;
+        }
+
+        //Open the checksum sidecar if it's used
+        m_CardType = highCapacity ? CARD_SDHC : CARD_SD;
+        m_BusFreq = m_Freq;
+        if (!openChecksums()) {
+            //Initialization failed
+            m_CardType = CARD_UNKNOWN;
+            return m_Status;
+        }
+
+        //The card is now initialized
+        m_Status &= ~STA_NOINIT;
+        return m_Status;
+    }
+
+    //Set the SPI frequency to 400kHz for initialization
+    m_Spi->frequency(400000);
+
+    //Try to reset the card up to 3 times
+    for (int f = 0; f < 3; f++) {
+        //Send 80 dummy clocks with /CS deasserted and DI held high
+        m_Spi->chip_select(false);
+        for (int i = 0; i < 10; i++) {
+            m_Spi->write(0xFF);
+        }
+
+        //Send CMD0(0x00000000) to reset the card
+        token = commandTransaction(CMD0, 0x00000000);
+        if (token == 0x01) {
+            break;
+        }
+    }
+
+    //Check if the card reset
+    if (token != 0x01) {
+        //Initialization failed
+        m_CardType = CARD_UNKNOWN;
+        return m_Status;
+    }
+
+    //Send CMD59(0x00000001) to enable CRC if necessary
+    if (crcEnabled()) {
+        if (commandTransaction(CMD59, 0x00000001) != 0x01) {
+            //Initialization failed
+            m_CardType = CARD_UNKNOWN;
+            return m_Status;
+        }
+    }
+
+    //Send CMD8(0x000001AA) to see if this is an SDCv2 card
+    if (commandTransaction(CMD8, 0x000001AA, &resp) == 0x01) {
+        //This is an SDCv2 card, get the 32-bit return value and verify the voltage range/check pattern
+        if ((resp & 0xFFF) != 0x1AA) {
+            //Initialization failed
+            m_CardType = CARD_UNKNOWN;
+            return m_Status;
+        }
+
+        //Send CMD58(0x00000000) to read the OCR, and verify that the card supports 3.2-3.3V
+        if (commandTransaction(CMD58, 0x00000000, &resp) != 0x01 || !(resp & (1 << 20))) {
+            //Initialization failed
+            m_CardType = CARD_UNKNOWN;
+            return m_Status;
+        }
+
+        //Try to initialize the card using ACMD41(0x40100000) for up to 2 seconds
+        timer.start();
+        do {
+            token = commandTransaction(ACMD41, 0x40100000, NULL, true);
+        } while (token == 0x01 && timer.read_ms() < 2000);
+        timer.stop();
+        timer.reset();
+
+        //Check if the card initialized
+        if (token != 0x00) {
+            //Initialization failed
+            m_CardType = CARD_UNKNOWN;
+            return m_Status;
+        }
+
+        //Reuse the card type if this is the card we initialized last time
+        if (recognizeCard() && m_Identity.type != CARD_MMC) {
+            m_CardType = m_Identity.type;
+        } else if (commandTransaction(CMD58, 0x00000000, &resp) == 0x00) {
+            //Read the OCR, and check the CCS bit to determine if this is a high capacity card
+            if (resp & (1 << 30))
+                m_CardType = CARD_SDHC;
+            else
+                m_CardType = CARD_SD;
+        } else {
+            //Initialization failed
+            m_CardType = CARD_UNKNOWN;
+            return m_Status;
+        }
+
+        //Increase the SPI frequency to full speed (up to 50MHz for SDCv2)
+        if (m_Freq > 25000000) {
+            if (enableHighSpeedMode()) {
+                if (m_Freq > 50000000) {
+                    setBusFrequency(50000000);
+                } else {
+                    setBusFrequency(m_Freq);
+                }
+            } else {
+                setBusFrequency(25000000);
+            }
+        } else {
+            setBusFrequency(m_Freq);
+        }
+    } else {
+        //Didn't respond or illegal command, this is either an SDCv1 or MMC card
+        //Send CMD58(0x00000000) to read the OCR, and verify that the card supports 3.2-3.3V
+        if (commandTransaction(CMD58, 0x00000000, &resp) != 0x01 || !(resp & (1 << 20))) {
+            //Initialization failed
+            m_CardType = CARD_UNKNOWN;
+            return m_Status;
+        }
+
+        //Try to initialize the card using ACMD41(0x40100000) for up to 2 seconds
+        timer.start();
+        do {
+            token = commandTransaction(ACMD41, 0x40100000, NULL, true);
+        } while (token == 0x01 && timer.read_ms() < 2000);
+        timer.stop();
+        timer.reset();
+
+        //Check if the card initialized
+        if (token == 0x00) {
+            //This is an SDCv1 standard capacity card
+            m_CardType = CARD_SD;
+            recognizeCard();
+
+            //Increase the SPI frequency to full speed (up to 25MHz for SDCv1)
+            if (m_Freq > 25000000)
+                setBusFrequency(25000000);
+            else
+                setBusFrequency(m_Freq);
+        } else {
+            //Try to initialize the card using CMD1(0x00100000) for up to 2 seconds
+            timer.start();
+            do {
+                token = commandTransaction(CMD1, 0x00100000);
+            } while (token == 0x01 && timer.read_ms() < 2000);
+            timer.stop();
+            timer.reset();
+
+            //Check if the card initialized
+            if (token == 0x00) {
+                //This is an MMCv3 card
+                m_CardType = CARD_MMC;
+                recognizeCard();
+
+                //Increase the SPI frequency to full speed (up to 20MHz for MMCv3)
+                if (m_Freq > 20000000)
+                    setBusFrequency(20000000);
+                else
+                    setBusFrequency(m_Freq);
+            } else {
+                //Initialization failed
+                m_CardType = CARD_UNKNOWN;
+                return m_Status;
+            }
+        }
+    }
+
+    //Send ACMD42(0x00000000) to disconnect the internal pull-up resistor on pin 1 if necessary
+    if (m_CardType != CARD_MMC) {
+        if (commandTransaction(ACMD42, 0x00000000, NULL, true) != 0x00) {
+            //Initialization failed
+            m_CardType = CARD_UNKNOWN;
+            return m_Status;
+        }
+    }
+
+    //Reject byte addressed cards if they aren't supported
+    if (SD_SDHC_ONLY && m_CardType != CARD_SDHC) {
+        //Initialization failed
+        m_CardType = CARD_UNKNOWN;
+        return m_Status;
+    }
+
+    //Send CMD16(0x00000200) to force the block size to 512B if necessary
+    if (m_CardType != CARD_SDHC) {
+        if (commandTransaction(CMD16, 0x00000200) != 0x00) {
+            //Initialization failed
+            m_CardType = CARD_UNKNOWN;
+            return m_Status;
+        }
+    }
+
+    //Find the highest stable SPI bus frequency if requested, reusing the last result for a recognized card
+    if (m_ClockTuning && m_Recognized && m_Identity.tuned) {
+        if (m_Identity.bus_frequency < m_BusFreq)
+            setBusFrequency(m_Identity.bus_frequency);
+    } else if (m_ClockTuning && !tuneClock(m_BusFreq)) {
+        //Initialization failed
+        m_CardType = CARD_UNKNOWN;
+        return m_Status;
+    }
+
+    //Read the card geometry, and remember the card's identity and settings for the next initialization
+    if (!readCardInfo()) {
+        //Initialization failed
+        m_CardType = CARD_UNKNOWN;
+        return m_Status;
+    }
+    rememberCard();
+
+    //Open the checksum sidecar if it's used
+    if (!openChecksums()) {
+        //Initialization failed
+        m_CardType = CARD_UNKNOWN;
+        return m_Status;
+    }
+
+    //The card is now initialized
+    m_Status &= ~STA_NOINIT;
+
+    //Return the disk status
+    return m_Status;
+}
+
+int SDDisk::disk_status()
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Check the card socket
+    checkSocket();
+
+    //Write any gathered sectors that have expired, and suspend the card if it's been idle for long enough
+    if (!(m_Status & STA_NOINIT)) {
+        checkGather();
+        checkIdle();
+    }
+
+    //Return the disk status
+    return m_Status;
+}
+
+int SDDisk::disk_read(uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Make sure the card is initialized before proceeding
+    if (m_Status & STA_NOINIT)
+        return RES_NOTRDY;
+
+    //Wake the card if it's suspended
+    if (!resumeCard())
+        return RES_ERROR;
+
+    //Write any gathered sectors that have expired, and any queued sectors the read overlaps
+    if (!checkGather())
+        return RES_ERROR;
+    if (m_Ring.overlaps(sector, count) && !drainRing(m_Ring.count()))
+        return RES_ERROR;
+
+    //Read through the sector cache if enabled
+    SD_STATS(unsigned int start = us_ticker_read());
+    bool success;
+    if (m_Cache.size() > 0)
+        success = cacheRead((char*)buffer, sector, count);
+    else
+        success = aheadRead((char*)buffer, sector, count);
+
+#if SD_ENABLE_STATS
+    //Update the read statistics
+    m_Stats.read_sectors.add(count);
+    m_Stats.read_us += us_ticker_read() - start;
+    if (success)
+        m_Stats.read_bytes += count << 9;
+    else
+        m_Stats.read_errors++;
+#endif
+
+    //Return success/failure
+    return success ? RES_OK : RES_ERROR;
+}
+
+int SDDisk::disk_write(const uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    //Serialize the writers, and queue the sectors without taking the card if the write ring is enabled
+    SDScopedLock ringLock(m_RingMutex);
+    if (m_Ring.size() > 0)
+        return ringWrite((const char*)buffer, sector, count);
+
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Make sure the card is initialized before proceeding
+    if (m_Status & STA_NOINIT)
+        return RES_NOTRDY;
+
+    //Make sure the card isn't write protected before proceeding
+    if (m_Status & STA_PROTECT)
+        return RES_WRPRT;
+
+    //Wake the card if it's suspended
+    if (!resumeCard())
+        return RES_ERROR;
+
+    //Write any gathered sectors that have expired
+    if (!checkGather())
+        return RES_ERROR;
+
+    //Write through the sector cache if enabled
+    SD_STATS(unsigned int start = us_ticker_read());
+    bool success = writeSectors((const char*)buffer, sector, count);
+
+#if SD_ENABLE_STATS
+    //Update the write statistics
+    m_Stats.write_sectors.add(count);
+    m_Stats.write_us += us_ticker_read() - start;
+    if (success)
+        m_Stats.write_bytes += count << 9;
+    else
+        m_Stats.write_errors++;
+#endif
+
+    //Return success/failure
+    return success ? RES_OK : RES_ERROR;
+}
+
+int SDDisk::disk_sync()
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Write everything back, and report any errors writing back sectors before an automatic suspend
+    int res = syncCard();
+    if (m_IdleError) {
+        m_IdleError = false;
+        return RES_ERROR;
+    }
+    return res;
+}
+
+int SDDisk::syncCard()
+{
+    //Everything was written back before the card was suspended, so there's nothing to do unless sectors have been queued since
+    if (m_Suspended && m_Ring.empty())
+        return RES_OK;
+
+    //Write any queued sectors, and report any errors writing them in the background
+    drainRing(m_Ring.count());
+    if (m_RingError) {
+        m_RingError = false;
+        return RES_ERROR;
+    }
+
+    //Write back any dirty and gathered sectors and checksums, and finalize any open write session
+    if (!flushCache() || !flushGather() || !flushChecksums() || !closeStream())
+        return RES_ERROR;
+
+    //Run any deferred write validation, and report any errors it has found
+    if (!finishValidation())
+        return RES_ERROR;
+
+    //Wake the card if it's still suspended, so we can wait for it
+    if (!resumeCard())
+        return RES_ERROR;
+
+    //Wait for the end of any internal write processes
+    if (m_Native != NULL)
+        return m_Native->status(500) ? RES_OK : RES_ERROR;
+
+    //Select the card so we're forced to wait for the end of any internal write processes
+    if (select()) {
+        deselect();
+        return RES_OK;
+    } else {
+        return RES_ERROR;
+    }
+}
+
+uint32_t SDDisk::disk_sectors()
+{
+    //Serialize access to the card
+    SDScopedLock lock(m_Mutex);
+
+    //Make sure the card is initialized before proceeding
+    if (m_Status & STA_NOINIT)
+        return 0;
+
+    //Return the sector count parsed from the CSD register during initialization, less the checksum sidecar if it's in use
+    return m_SidecarActive ? m_SidecarData : m_Info.sectors;
+}
+
+void SDDisk::onCardRemoval()
+{
+    //Just flag the removal, it's handled by the next transaction so the status is never changed mid-transaction
+    m_CardRemoved = true;
+}
+
+inline void SDDisk::checkSocket()
+{
+    //Handle a removal flagged by the card detect interrupt, even if a card has been inserted again since
+    if (m_CardRemoved) {
+        m_CardRemoved = false;
+        m_Status |= STA_NOINIT;
+        if (!(m_Status & STA_NODISK))
+            m_CardType = CARD_UNKNOWN;
+    }
+
+    //Use the card detect switch (if available) to determine if the socket is occupied
+    if (m_CdAssert != -1) {
+        if (m_Status & STA_NODISK) {
+            if (m_Cd == m_CdAssert) {
+                //The socket is now occupied
+                m_Status &= ~STA_NODISK;
+                m_CardType = CARD_UNKNOWN;
+            }
+        } else {
+            if (m_Cd != m_CdAssert) {
+                //The socket is now empty
+                m_Status |= (STA_NODISK | STA_NOINIT);
+                m_CardType = CARD_NONE;
+            }
+        }
+    }
+}
+
+bool SDDisk::queueAsync(AsyncOp op, uint8_t* buffer, uint32_t sector, uint32_t count, Callback<void(int)> callback)
+{
+    //Make sure there's room in the queue before proceeding
+    unsigned int next = (m_AsyncHead + 1) % (SD_ASYNC_QUEUE_SIZE + 1);
+    if (next == m_AsyncTail)
+        return false;
+
+    //Fill in the request, and publish it to the state machine
+    AsyncRequest& request = m_AsyncQueue[m_AsyncHead];
+    request.op = op;
+    request.buffer = buffer;
+    request.sector = sector;
+    request.count = count;
+    request.callback = callback;
+    m_AsyncHead = next;
+    return true;
+}
+
+void SDDisk::finishAsync(int result)
+{
+    //Retire the current request before notifying the caller so the callback can queue another
+    Callback<void(int)> callback = m_AsyncQueue[m_AsyncTail].callback;
+    m_AsyncTimer.stop();
+    m_AsyncState = ASYNC_IDLE;
+    m_AsyncTail = (m_AsyncTail + 1) % (SD_ASYNC_QUEUE_SIZE + 1);
+
+    //Invoke the completion callback
+    callback.call(result);
+}
+
+inline bool SDDisk::crcEnabled() const
+{
+    //Return the compile time setting if there is one, so the unused path folds away
+    return (SD_FIXED_CRC < 0) ? m_Crc : (SD_FIXED_CRC != 0);
+}
+
+inline bool SDDisk::largeFrames() const
+{
+    //Return the compile time setting if there is one, so the unused frame loop folds away
+    return (SD_FIXED_LARGE_FRAMES < 0) ? m_LargeFrames : (SD_FIXED_LARGE_FRAMES != 0);
+}
+
+inline SDDisk::ValidationMode SDDisk::validationMode() const
+{
+    //Return the compile time policy if there is one, so the unused checks fold away
+    return (SD_FIXED_VALIDATION < 0) ? m_ValidationMode : (ValidationMode)SD_FIXED_VALIDATION;
+}
+
+inline unsigned int SDDisk::cardAddress(unsigned int lba) const
+{
+    //Block addressed cards take the sector number, byte addressed cards take the byte offset
+    return (SD_SDHC_ONLY || m_CardType == CARD_SDHC) ? lba : lba << 9;
+}
+
+inline bool SDDisk::pollReady()
+{
+    //Ask a native transport instead
+    if (m_Native != NULL)
+        return m_Native->ready();
+
+    //Assert /CS, and send 8 dummy clocks with DI held high to enable DO
+    m_Spi->chip_select(true);
+    m_Spi->write(0xFF);
+
+    //Sample the DO line once
+    char resp = m_Spi->write(0xFF);
+
+    //Deselect the card, and return whether or not it has released the DO line
+    deselect();
+    return (resp > 0x00);
+}
+
+inline void SDDisk::pollDelay(int polls)
+{
+    //Spin for the first few polls, since most waits are short
+    if (m_WaitMode == WAIT_SPIN || polls < 16)
+        return;
+
+    //Back off exponentially from 8us up to the maximum delay
+    int shift = polls - 16;
+    int delay = (shift < 16) ? (8 << shift) : m_WaitMaxDelay;
+    if (delay > m_WaitMaxDelay)
+        delay = m_WaitMaxDelay;
+
+#if SD_USE_RTOS
+    //Let other threads run while we wait
+    if (m_WaitMode == WAIT_YIELD) {
+        if (delay >= 1000)
+            Thread::wait(delay / 1000);
+        else
+            Thread::yield();
+        return;
+    }
+#endif
+
+    //Stop clocking the bus for a while
+    wait_us(delay);
+}
+
+inline void SDDisk::recordWait(SDDisk::WaitStats* stats, int us, bool timedOut)
+{
+    //Accumulate the wait timing
+    stats->count++;
+    stats->total_us += us;
+    if ((unsigned int)us > stats->max_us)
+        stats->max_us = us;
+    if (timedOut)
+        stats->timeouts++;
+}
+
+inline bool SDDisk::waitReady(int timeout)
+{
+    char resp;
+
+    //Keep sending dummy clocks with DI held high until the card releases the DO line
+    m_Timer.start();
+    for (int polls = 0; ; polls++) {
+        resp = m_Spi->write(0xFF);
+        if (resp != 0x00 || m_Timer.read_ms() >= timeout || m_CardRemoved)
+            break;
+        if (polls >= 16 && m_WaitMode != WAIT_SPIN && m_Spi->shared()) {
+            //Deselecting a busy card is allowed, so let the other cards use the bus while we back off
+            m_Spi->chip_select(false);
+            pollDelay(polls);
+            m_Spi->chip_select(true);
+        } else {
+            pollDelay(polls);
+        }
+    }
+    m_Timer.stop();
+    recordWait(&m_BusyWaits, m_Timer.read_us(), resp == 0x00);
+    SD_STATS(m_Stats.busy_us.add(m_Timer.read_us()));
+    m_Timer.reset();
+
+    //Return success/failure
+    return (resp > 0x00);
+}
+
+inline bool SDDisk::select()
+{
+    //Assert /CS
+    m_Spi->chip_select(true);
+
+    //Send 8 dummy clocks with DI held high to enable DO
+    m_Spi->write(0xFF);
+
+    //Wait for up to 500ms for the card to become ready
+    if (waitReady(500)) {
+        return true;
+    } else {
+        //We timed out, deselect and return false
+        deselect();
+        return false;
+    }
+}
+
+inline void SDDisk::deselect()
+{
+    //Deassert /CS
+    m_Spi->chip_select(false);
+
+    //Send 8 dummy clocks with DI held high to disable DO
+    m_Spi->write(0xFF);
+}
+
+inline char SDDisk::commandTransaction(unsigned char cmd, unsigned int arg, unsigned int* resp, bool app)
+{
+    //Select the card, and wait for ready
+    if(!select())
+        return 0xFF;
+
+    //Perform the command transaction
+    char token = writeCommand(cmd, arg, resp, app);
+
+    //Deselect the card, and return the R1 response token
+    deselect();
+    return token;
+}
+
+inline bool SDDisk::chainCommand()
+{
+    //The card only needs 8 clocks between a response and the next command, so keep it selected when batching
+    if (m_CommandBatching) {
+        m_Spi->write(0xFF);
+        return true;
+    }
+
+    //Otherwise deselect and reselect the card, and wait for ready
+    deselect();
+    return select();
+}
+
+bool SDDisk::stopTransmission()
+{
+    //Send the stop tran token
+    m_Spi->write(0xFD);
+
+    //Read the card status under the same chip select if the validation policy checks every write
+    if (m_CommandBatching && validationMode() == VALIDATE_EACH) {
+        //Skip the byte before the busy signal, and wait for up to 500ms for programming to finish
+        m_Spi->write(0xFF);
+        bool success = waitReady(500);
+
+        //Send CMD13(0x00000000) to read the card status
+        unsigned int resp;
+        if (success && (writeCommand(CMD13, 0x00000000, &resp) != 0x00 || resp != 0x00))
+            success = false;
+
+        //Deselect the card, and return success/failure
+        deselect();
+        return success;
+    }
+
+    //Deselect the card
+    deselect();
+
+    //Verify that the programming was successful according to the validation policy
+    return checkValidation();
+}
+
+char SDDisk::writeCommand(unsigned char cmd, unsigned int arg, unsigned int* resp, bool app)
+{
+    char token;
+    SD_STATS(unsigned int start = us_ticker_read());
+
+    //Try to send the command as many times as the recovery policy allows
+    for (int f = 0; f < m_Recovery.retries; f++) {
+        //Send CMD55(0x00000000) prior to an application specific command
+        if (app) {
+            token = writeCommand(CMD55, 0x00000000);
+            if (token > 0x01)
+                return token;
+
+            //Chain the ACMD on to CMD55
+            if (!chainCommand())
+                return 0xFF;
+        }
+
+        //Prepare the command packet
+        char cmdPacket[6];
+        cmdPacket[0] = cmd;
+        cmdPacket[1] = arg >> 24;
+        cmdPacket[2] = arg >> 16;
+        cmdPacket[3] = arg >> 8;
+        cmdPacket[4] = arg;
+        if (crcEnabled() || cmd == CMD0 || cmd == CMD8)
+            cmdPacket[5] = (SDCRC::crc7(cmdPacket, 5) << 1) | 0x01;
+        else
+            cmdPacket[5] = 0x01;
+
+        //Send the command packet
+        for (int i = 0; i < 6; i++)
+            m_Spi->write(cmdPacket[i]);
+
+        //Discard the stuff byte immediately following CMD12
+        if (cmd == CMD12)
+            m_Spi->write(0xFF);
+
+        //Allow up to 8 bytes of delay for the R1 response token
+        for (int i = 0; i < 9; i++) {
+            token = m_Spi->write(0xFF);
+            if (!(token & 0x80))
+                break;
+        }
+
+        //Verify the R1 response token
+        if (token == 0xFF) {
+            //No data was received, get out early
+            break;
+        } else if (token & (1 << 3)) {
+            //There was a CRC error, try again
+            SD_STATS(m_Stats.command_crc_retries++);
+            recordRetry(RETRY_COMMAND_CRC);
+            continue;
+        } else if (token > 0x01) {
+            //An error occured, get out early
+            break;
+        }
+
+        //Handle R2 and R3/R7 response tokens
+        if (cmd == CMD13) {
+            //Read the R2 response value (always for ACMD13, since its data block follows)
+            unsigned int status = m_Spi->write(0xFF);
+            if (resp != NULL)
+                *resp = status;
+        } else if ((cmd == CMD8 || cmd == CMD58) && resp != NULL) {
+            //Read the R3/R7 response value
+            *resp = (m_Spi->write(0xFF) << 24);
+            *resp |= (m_Spi->write(0xFF) << 16);
+            *resp |= (m_Spi->write(0xFF) << 8);
+            *resp |= m_Spi->write(0xFF);
+        }
+
+        //The command was successful
+        break;
+    }
+
+    //Record the command latency
+    SD_STATS(m_Stats.command_us.add(us_ticker_read() - start));
+
+    //Return the R1 response token
+    return token;
+}
+
+inline bool SDDisk::sampleRead()
+{
+    //Check every block unless sampling is enabled, otherwise check 1 in every m_CrcSampling blocks
+    if (m_CrcSampling <= 1)
+        return true;
+    if (++m_CrcSampleCount < m_CrcSampling)
+        return false;
+    m_CrcSampleCount = 0;
+    return true;
+}
+
+bool SDDisk::readData(char* buffer, int length, bool verify)
+{
+    unsigned short crc;
+
+    //Read the data block
+    if (!readData(buffer, length, &crc, NULL, NULL))
+        return false;
+
+    //Check the validity of the CRC16 checksum (if enabled and requested)
+    if (verify && crcEnabled() && crc != SDCRC::crc16(buffer, length)) {
+        SD_STATS(m_Stats.read_crc_errors++);
+        recordRetry(RETRY_READ_CRC);
+        return false;
+    }
+
+    //The data block is valid
+    return true;
+}
+
+bool SDDisk::readData(char* buffer, int length, unsigned short* crc, const char* crcBuffer, unsigned short* bufferCrc)
+{
+    char token;
+
+    //Wait for up to 500ms for a token to arrive
+    m_Timer.start();
+    for (int polls = 0; ; polls++) {
+        token = m_Spi->write(0xFF);
+        if (token != 0xFF || m_Timer.read_ms() >= 500 || m_CardRemoved)
+            break;
+        pollDelay(polls);
+    }
+    m_Timer.stop();
+    recordWait(&m_TokenWaits, m_Timer.read_us(), token == 0xFF);
+    SD_STATS(m_Stats.token_us.add(m_Timer.read_us()));
+    m_Timer.reset();
+
+    //Check if a valid start block token was received
+    if (token != 0xFE) {
+        recordRetry(RETRY_READ_TOKEN);
+
+        //Calculate the pending checksum anyway so the caller can still verify its block
+        if (crcBuffer != NULL)
+            *bufferCrc = SDCRC::crc16(crcBuffer, 512);
+        return false;
+    }
+
+#if DEVICE_SPI_ASYNCH
+    //Use a bulk transfer for the data block if DMA is enabled
+    if (m_Dma && m_Spi->start_transfer(NULL, buffer, length)) {
+        //Calculate the pending checksum while the data block streams in
+        if (crcBuffer != NULL) {
+            *bufferCrc = SDCRC::crc16(crcBuffer, 512);
+            crcBuffer = NULL;
+        }
+        m_Spi->finish_transfer();
+
+        //Read the CRC16 checksum for the data block
+        *crc = (m_Spi->write(0xFF) << 8);
+        *crc |= m_Spi->write(0xFF);
+    } else
+#endif
+    //Read word-aligned buffers in one block transfer if the transport supports it, with no byte shuffling
+    if (wordAligned(buffer) && m_Spi->transfer(NULL, buffer, length)) {
+        //Read the CRC16 checksum for the data block
+        *crc = (m_Spi->write(0xFF) << 8);
+        *crc |= m_Spi->write(0xFF);
+    } else if (largeFrames()) {
+        //Switch to 16-bit frames for better performance
+        m_Spi->format(16);
+
+        //Read the data block into the buffer
+        unsigned short dataWord;
+        for (int i = 0; i < length; i += 2) {
+            dataWord = m_Spi->write(0xFFFF);
+            buffer[i] = dataWord >> 8;
+            buffer[i + 1] = dataWord;
+        }
+
+        //Read the CRC16 checksum for the data block
+        *crc = m_Spi->write(0xFFFF);
+
+        //Switch back to 8-bit frames
+        m_Spi->format(8);
+    } else {
+        //Read the data into the buffer
+        for (int i = 0; i < length; i++)
+            buffer[i] = m_Spi->write(0xFF);
+
+        //Read the CRC16 checksum for the data block
+        *crc = (m_Spi->write(0xFF) << 8);
+        *crc |= m_Spi->write(0xFF);
+    }
+
+    //Calculate the pending checksum if it couldn't be overlapped with the transfer
+    if (crcBuffer != NULL)
+        *bufferCrc = SDCRC::crc16(crcBuffer, 512);
+
+    //The data block was received
+    return true;
+}
+
+char SDDisk::writeData(const char* buffer, char token, unsigned short crc, const char* crcBuffer, unsigned short* bufferCrc)
+{
+    //Wait for up to 500ms for the card to become ready
+    if (!waitReady(500))
+        return false;
+
+    //Send the start block token
+    m_Spi->write(token);
+
+#if DEVICE_SPI_ASYNCH
+    //Use a bulk transfer for the data block if DMA is enabled
+    if (m_Dma && m_Spi->start_transfer(buffer, NULL, 512)) {
+        //Calculate the pending checksum while the data block streams out
+        if (crcBuffer != NULL) {
+            *bufferCrc = SDCRC::crc16(crcBuffer, 512);
+            crcBuffer = NULL;
+        }
+        m_Spi->finish_transfer();
+
+        //Send the CRC16 checksum for the data block
+        m_Spi->write(crc >> 8);
+        m_Spi->write(crc);
+    } else
+#endif
+    //Write word-aligned buffers in one block transfer if the transport supports it, with no byte shuffling
+    if (wordAligned(buffer) && m_Spi->transfer(buffer, NULL, 512)) {
+        //Send the CRC16 checksum for the data block
+        m_Spi->write(crc >> 8);
+        m_Spi->write(crc);
+    } else if (largeFrames()) {
+        //Switch to 16-bit frames for better performance
+        m_Spi->format(16);
+
+        //Write the data block from the buffer
+        for (int i = 0; i < 512; i += 2)
+            m_Spi->write((buffer[i] << 8) | buffer[i + 1]);
+
+        //Send the CRC16 checksum for the data block
+        m_Spi->write(crc);
+
+        //Switch back to 8-bit frames
+        m_Spi->format(8);
+    } else {
+        //Write the data block from the buffer
+        for (int i = 0; i < 512; i++)
+            m_Spi->write(buffer[i]);
+
+        //Send the CRC16 checksum for the data block
+        m_Spi->write(crc >> 8);
+        m_Spi->write(crc);
+    }
+
+    //Calculate the pending checksum if it couldn't be overlapped with the transfer
+    if (crcBuffer != NULL)
+        *bufferCrc = SDCRC::crc16(crcBuffer, 512);
+
+    //Return the data response token
+    return (m_Spi->write(0xFF) & 0x1F);
+}
+
+bool SDDisk::cacheRead(char* buffer, unsigned int lba, unsigned int count)
+{
+    //Serve single sector reads from the cache
+    if (count == 1) {
+        int slot = m_Cache.find(lba);
+        if (slot < 0) {
+            //Make room for the sector, and load it from the card
+            slot = m_Cache.victim();
+            if (!evictSlot(slot))
+                return false;
+            if (!aheadRead(m_Cache.data(slot), lba, 1)) {
+                //The slot's old contents were overwritten by the failed read, so stop serving them
+                m_Cache.invalidate(slot);
+                return false;
+            }
+            m_Cache.assign(slot, lba, false);
+        }
+
+        //Copy the sector out of the cache
+        memcpy(buffer, m_Cache.data(slot), 512);
+        return true;
+    }
+
+    //Read larger transfers straight from the card so they don't flush the cache
+    if (!aheadRead(buffer, lba, count))
+        return false;
+
+    //Overlay any dirty sectors, since they're newer than the card
+    for (int i = 0; i < m_Cache.size(); i++) {
+        if (m_Cache.dirty(i) && m_Cache.sector(i) >= lba && m_Cache.sector(i) - lba < count)
+            memcpy(buffer + ((m_Cache.sector(i) - lba) << 9), m_Cache.data(i), 512);
+    }
+    return true;
+}
+
+bool SDDisk::cacheWrite(const char* buffer, unsigned int lba, unsigned int count)
+{
+    //Absorb single sector writes into the cache
+    if (count == 1) {
+        int slot = m_Cache.find(lba);
+        if (slot < 0) {
+            //Make room for the sector
+            slot = m_Cache.victim();
+            if (!evictSlot(slot))
+                return false;
+        }
+
+        //Copy the sector into the cache, and mark it dirty
+        memcpy(m_Cache.data(slot), buffer, 512);
+        m_Cache.assign(slot, lba, true);
+        return true;
+    }
+
+    //Write larger transfers straight to the card
+    if (!gatherWrite(buffer, lba, count))
+        return false;
+
+    //Refresh any cached copies of the sectors that were just written
+    for (int i = 0; i < m_Cache.size(); i++) {
+        if (m_Cache.valid(i) && m_Cache.sector(i) >= lba && m_Cache.sector(i) - lba < count) {
+            memcpy(m_Cache.data(i), buffer + ((m_Cache.sector(i) - lba) << 9), 512);
+            m_Cache.clean(i);
+        }
+    }
+    return true;
+}
+
+bool SDDisk::evictSlot(int slot)
+{
+    //Write back the slot if it's dirty
+    if (m_Cache.dirty(slot)) {
+        if (!gatherWrite(m_Cache.data(slot), m_Cache.sector(slot), 1))
+            return false;
+        m_Cache.clean(slot);
+    }
+
+    //The slot can now be reused
+    return true;
+}
+
+bool SDDisk::flushCache()
+{
+    //Write back the dirty sectors in ascending order
+    for (int slot = m_Cache.nextDirty(); slot >= 0; slot = m_Cache.nextDirty()) {
+        if (!evictSlot(slot))
+            return false;
+    }
+
+    //The cache now matches the card
+    return true;
+}
+
+bool SDDisk::aheadRead(char* buffer, unsigned int lba, unsigned int count)
+{
+    //Read straight from the card if read-ahead is disabled
+    if (m_AheadSize == 0)
+        return gatherRead(buffer, lba, count);
+
+    //Check whether or not this read continues the previous one
+    bool sequential = (lba == m_AheadNext);
+    m_AheadNext = lba + count;
+
+    //Serve as much of the read as possible from the prefetched sectors
+    while (count > 0 && lba >= m_AheadLba && lba - m_AheadLba < m_AheadCount) {
+        memcpy(buffer, m_AheadBuffer + ((lba - m_AheadLba) << 9), 512);
+        buffer += 512;
+        lba++;
+        count--;
+    }
+    if (count == 0)
+        return true;
+
+    //Reset the window on random access, and read straight from the card
+    if (!sequential) {
+        m_AheadDepth = 0;
+        return gatherRead(buffer, lba, count);
+    }
+
+    //Grow the window on each sequential miss, up to the size of the buffer
+    m_AheadDepth = (m_AheadDepth == 0) ? 4 : m_AheadDepth * 2;
+    if (m_AheadDepth > m_AheadSize)
+        m_AheadDepth = m_AheadSize;
+
+    //Read large transfers straight from the card
+    if (count >= m_AheadDepth)
+        return gatherRead(buffer, lba, count);
+
+    //Prefetch the window, falling back to a direct read if it fails (at the end of the card, for example)
+    m_AheadCount = 0;
+    if (!gatherRead(m_AheadBuffer, lba, m_AheadDepth)) {
+        m_AheadDepth = 0;
+        return gatherRead(buffer, lba, count);
+    }
+    m_AheadLba = lba;
+    m_AheadCount = m_AheadDepth;
+
+    //Copy the requested sectors out of the window
+    memcpy(buffer, m_AheadBuffer, count << 9);
+    return true;
+}
+
+bool SDDisk::gatherRead(char* buffer, unsigned int lba, unsigned int count)
+{
+    //Write any gathered sectors the read overlaps first
+    if (gatherOverlaps(lba, count) && !flushGather())
+        return false;
+
+    //Read from the card
+    return cardRead(buffer, lba, count);
+}
+
+bool SDDisk::gatherWrite(const char* buffer, unsigned int lba, unsigned int count)
+{
+    //Discard any prefetched sectors, since they may be stale now
+    m_AheadCount = 0;
+
+    //Write straight to the card if write gathering is disabled
+    if (m_GatherSize == 0)
+        return cardWrite(buffer, lba, count);
+
+    //Write the gathered sectors if this write doesn't extend them
+    if (m_GatherCount > 0 && (count > 1 || lba != m_GatherLba + m_GatherCount)) {
+        if (!flushGather())
+            return false;
+    }
+
+    //Write multiple block transfers straight to the card
+    if (count > 1)
+        return cardWrite(buffer, lba, count);
+
+    //Start a new run if necessary
+    if (m_GatherCount == 0) {
+        m_GatherLba = lba;
+        m_GatherTimer.reset();
+        m_GatherTimer.start();
+    }
+
+    //Append the sector to the run
+    memcpy(m_GatherBuffer + (m_GatherCount << 9), buffer, 512);
+    m_GatherCount++;
+
+    //Write the run once the buffer is full, or it reaches an allocation unit boundary
+    if (m_GatherCount == m_GatherSize || auBoundary(lba + 1))
+        return flushGather();
+    return true;
+}
+
+inline bool SDDisk::gatherOverlaps(unsigned int lba, unsigned int count)
+{
+    //Return whether or not the range overlaps the gathered sectors
+    return (m_GatherCount > 0 && lba < m_GatherLba + m_GatherCount && m_GatherLba < lba + count);
+}
+
+bool SDDisk::flushGather()
+{
+    //Get out if there's nothing to write
+    if (m_GatherCount == 0)
+        return true;
+
+    //Write the gathered sectors as a single transfer
+    bool success = cardWrite(m_GatherBuffer, m_GatherLba, m_GatherCount);
+    m_GatherCount = 0;
+    m_GatherTimer.stop();
+    return success;
+}
+
+inline bool SDDisk::checkGather()
+{
+    //Write the gathered sectors if they've expired
+    if (m_GatherCount > 0 && m_GatherTimer.read_ms() >= m_GatherTimeout)
+        return flushGather();
+    return true;
+}
+
+inline bool SDDisk::writeSectors(const char* buffer, unsigned int lba, unsigned int count)
+{
+    //Update the sectors' checksums
+    if (!setChecksums(buffer, lba, count))
+        return false;
+
+    //Write through the sector cache if enabled
+    if (m_Cache.size() > 0)
+        return cacheWrite(buffer, lba, count);
+    else
+        return gatherWrite(buffer, lba, count);
+}
+
+int SDDisk::ringWrite(const char* buffer, unsigned int lba, unsigned int count)
+{
+    //Make sure the card is initialized before proceeding
+    if (m_Status & STA_NOINIT)
+        return RES_NOTRDY;
+
+    //Make sure the card isn't write protected before proceeding
+    if (m_Status & STA_PROTECT)
+        return RES_WRPRT;
+
+    //Report any errors writing previously queued sectors
+    if (m_RingError) {
+        m_RingError = false;
+        return RES_ERROR;
+    }
+
+    for (unsigned int i = 0; i < count; i++) {
+        if (m_Ring.full()) {
+            //Apply back-pressure by waiting for the flusher to finish its current run, and writing the oldest run ourselves if it's still full
+            unsigned int start = us_ticker_read();
+            {
+                SDScopedLock lock(m_Mutex);
+                if (m_Ring.full() && !drainRing(1)) {
+                    m_RingError = false;
+                    return RES_ERROR;
+                }
+            }
+            unsigned int us = us_ticker_read() - start;
+            m_RingStats.stalls++;
+            m_RingStats.stall_us += us;
+            if (us > m_RingStats.max_stall_us)
+                m_RingStats.max_stall_us = us;
+        }
+
+        //Copy the sector into the ring, and publish it to the flusher
+        memcpy(m_Ring.backData(), buffer, 512);
+        m_Ring.push(lba);
+        buffer += 512;
+        lba++;
+        if (m_Ring.count() > m_RingStats.high_water)
+            m_RingStats.high_water = m_Ring.count();
+#if SD_USE_RTOS
+        m_RingReady.release();
+#endif
+    }
+
+    //The sectors will be written in the background
+    return RES_OK;
+}
+
+bool SDDisk::drainRing(unsigned int count)
+{
+    //Wake the card if it's suspended (queued sectors are discarded below if it fails to initialize)
+    if (count > 0 && !m_Ring.empty())
+        resumeCard();
+
+    //Write runs from the front of the ring until at least the requested number of sectors have been written
+    bool success = true;
+    while (count > 0 && !m_Ring.empty()) {
+        //Write the run of consecutive sectors as one transfer, discarding it if the card has gone away
+        unsigned int run = m_Ring.run();
+        if ((m_Status & STA_NOINIT) || !writeSectors(m_Ring.frontData(), m_Ring.frontSector(), run)) {
+            m_RingError = true;
+            success = false;
+        }
+        m_Ring.pop(run);
+        m_RingStats.bursts++;
+        count -= (run < count) ? run : count;
+    }
+
+    //Return success/failure
+    return success;
+}
+
+#if SD_USE_RTOS
+void SDDisk::ringTask()
+{
+    while (!m_RingStop) {
+        //Sleep until sectors are queued, or the gathered sectors or the card may have expired
+        int timeout = (m_GatherTimeout > 0) ? m_GatherTimeout : m_IdleTimeout;
+        m_RingReady.wait((timeout > 0) ? timeout : osWaitForever);
+
+        //Write the ring one run at a time, so other transactions can get in between them
+        bool more = true;
+        while (more && !m_RingStop) {
+            SDScopedLock lock(m_Mutex);
+            drainRing(1);
+            more = !m_Ring.empty();
+            if (!more && !(m_Status & STA_NOINIT)) {
+                checkGather();
+                checkIdle();
+            }
+        }
+    }
+}
+
+void SDDisk::stopRing()
+{
+    //Get out if the flusher thread isn't running
+    if (m_RingThread == NULL)
+        return;
+
+    //Wake the flusher thread, and wait for it to exit
+    m_RingStop = true;
+    m_RingReady.release();
+    m_RingThread->join();
+    delete m_RingThread;
+    m_RingThread = NULL;
+}
+#endif
+
+bool SDDisk::streamWrite(const char* buffer, unsigned int lba, unsigned int count)
+{
+    //Finalize the open session if this write doesn't follow on from it, or starts a new allocation unit
+    if (m_StreamOpen && (lba != m_StreamLba || auBoundary(lba)) && !closeStream())
+        return false;
+
+    //Select the card, and wait for ready
+    if (!select())
+        return false;
+
+    //Open a new session if necessary
+    if (!m_StreamOpen) {
+        //Send CMD25(block) to write multiple blocks
+        if (writeCommand(CMD25, cardAddress(lba)) != 0x00) {
+            //The command failed, get out
+            deselect();
+            return false;
+        }
+
+        //The session is now open, and the data blocks follow under the same chip select if batching
+        m_StreamOpen = true;
+        m_StreamLba = lba;
+        if (!chainCommand())
+            return false;
+    }
+
+    //Calculate the CRC16 checksum for the first data block (if enabled)
+    unsigned short crc = crcEnabled() ? SDCRC::crc16(buffer, 512) : 0xFFFF;
+
+    //Write each block into the session
+    do {
+        //Write the next block while calculating the CRC16 checksum of the following block
+        unsigned short nextCrc = 0xFFFF;
+        char token = writeData(buffer, 0xFC, crc, (crcEnabled() && count > 1) ? buffer + 512 : NULL, &nextCrc);
+        if (token != 0x05) {
+            //The block was rejected, send CMD12(0x00000000) to abort the session
+            writeCommand(CMD12, 0x00000000);
+            deselect();
+            m_StreamOpen = false;
+
+            //Fall back to a regular write for the remaining blocks
+            return (count > 1) ? writeBlocks(buffer, lba, count) : writeBlock(buffer, lba, true);
+        }
+
+        //Update the variables
+        buffer += 512;
+        lba++;
+        m_StreamLba++;
+        crc = nextCrc;
+    } while (--count);
+
+    //Deselect the card, leaving the session open
+    deselect();
+    return true;
+}
+
+bool SDDisk::closeStream()
+{
+    //Get out if there's no session open
+    if (!m_StreamOpen)
+        return true;
+    m_StreamOpen = false;
+
+    //Select the card, and wait for it to finish processing the last block
+    if (!select())
+        return false;
+
+    //Send the stop tran token, and verify that the programming was successful according to the validation policy
+    if (!stopTransmission()) {
+        //Some manner of unrecoverable write error occured during programming
+        return false;
+    }
+
+    //The session was finalized successfully
+    return true;
+}
+
+bool SDDisk::sessionWrite(const char* buffer, unsigned int lba, unsigned int count)
+{
+    //Finalize the open session if this block doesn't follow on from it, or starts a new allocation unit
+    if (m_StreamOpen && (lba != m_StreamLba || auBoundary(lba)) && !closeStream())
+        return false;
+
+    //Select the card (the async engine has already waited for ready)
+    if (!select())
+        return false;
+
+    //Open a new session if necessary
+    if (!m_StreamOpen) {
+        //If this is an SD card, send ACMD23(count) to set the number of blocks to pre-erase, and chain CMD25 on to it
+        if (m_CardType != CARD_MMC && (writeCommand(ACMD23, count, NULL, true) != 0x00 || !chainCommand())) {
+            //The command failed, get out
+            deselect();
+            return false;
+        }
+
+        //Send CMD25(block) to write multiple blocks
+        if (writeCommand(CMD25, cardAddress(lba)) != 0x00) {
+            //The command failed, get out
+            deselect();
+            return false;
+        }
+
+        //The session is now open, and the data block follows under the same chip select if batching
+        m_StreamOpen = true;
+        m_StreamLba = lba;
+        if (!chainCommand())
+            return false;
+    }
+
+    //Write the block into the session
+    char token = writeData(buffer, 0xFC, crcEnabled() ? SDCRC::crc16(buffer, 512) : 0xFFFF, NULL, NULL);
+    if (token != 0x05) {
+        //The block was rejected, send CMD12(0x00000000) to abort the session
+        writeCommand(CMD12, 0x00000000);
+        deselect();
+        m_StreamOpen = false;
+
+        //Fall back to a regular write for this block
+        return writeBlock(buffer, lba, true);
+    }
+
+    //Deselect the card, leaving the session open for the next block
+    m_StreamLba++;
+    deselect();
+    return true;
+}
+
+inline bool SDDisk::cardRead(char* buffer, unsigned int lba, unsigned int count)
+{
+    //Finalize any open multiple block write session
+    if (!closeStream())
+        return false;
+
+    //Read a single block, or multiple blocks, in bursts no larger than the recovery policy allows
+    bool success = true;
+    while (success && count > 0) {
+        unsigned int limit = burstLimit();
+        unsigned int run = (limit > 0 && count > limit) ? limit : count;
+        if (run > 1)
+            success = readBlocks(buffer, lba, run);
+        else
+            success = readBlock(buffer, lba);
+
+        //Apply the recovery policy if errors are climbing
+        checkErrorRate(run);
+        buffer += run << 9;
+        lba += run;
+        count -= run;
+    }
+
+    //Return success/failure
+    return success;
+}
+
+inline bool SDDisk::cardWrite(const char* buffer, unsigned int lba, unsigned int count)
+{
+    //Split the write at allocation unit boundaries if requested, so no burst spans two units
+    unsigned int au = m_AuAlignment ? m_Info.au_sectors : 0;
+    while (au > 0 && count > au - (lba % au)) {
+        unsigned int run = au - (lba % au);
+        if (!burstWrite(buffer, lba, run))
+            return false;
+        buffer += run << 9;
+        lba += run;
+        count -= run;
+    }
+
+    //Write the rest of the data
+    return burstWrite(buffer, lba, count);
+}
+
+bool SDDisk::burstWrite(const char* buffer, unsigned int lba, unsigned int count)
+{
+    //Split the write into bursts no larger than the recovery policy allows
+    unsigned int limit = burstLimit();
+    while (limit > 0 && count > limit) {
+        if (!burstWrite(buffer, lba, limit))
+            return false;
+        buffer += limit << 9;
+        lba += limit;
+        count -= limit;
+    }
+
+    //Write into an open multiple block write session if streaming is enabled (SPI mode only), otherwise write a single block or multiple blocks
+    bool success;
+    if (m_WriteStreaming && m_Native == NULL)
+        success = streamWrite(buffer, lba, count);
+    else if (count > 1)
+        success = writeBlocks(buffer, lba, count);
+    else
+        success = writeBlock(buffer, lba, true);
+
+    //Apply the recovery policy if errors are climbing
+    checkErrorRate(count);
+    return success;
+}
+
+inline bool SDDisk::auBoundary(unsigned int lba)
+{
+    //Return whether or not writes are being aligned, and the sector starts an allocation unit
+    return (m_AuAlignment && m_Info.au_sectors > 0 && lba % m_Info.au_sectors == 0);
+}
+
+bool SDDisk::eraseBlocks(unsigned int lba, unsigned int count)
+{
+    //Allow 250ms per allocation unit (assuming 4MB units if the size is unknown), as the SD specification does
+    unsigned int au = (m_Info.au_sectors > 0) ? m_Info.au_sectors : 8192;
+    int timeout = 250 * (count / au + 2);
+
+    //Native transports erase through the host controller
+    if (m_Native != NULL)
+        return m_Native->erase_blocks(lba, count) && m_Native->status(timeout);
+
+    //Select the card, and wait for ready
+    if (!select())
+        return false;
+
+    //Send CMD32/CMD33 (CMD35/CMD36 for MMC) to set the first and last blocks to erase, chaining each command
+    unsigned int start = cardAddress(lba);
+    unsigned int end = cardAddress(lba + count - 1);
+    bool success = (writeCommand((m_CardType == CARD_MMC) ? CMD35 : CMD32, start) == 0x00 && chainCommand());
+    success = success && (writeCommand((m_CardType == CARD_MMC) ? CMD36 : CMD33, end) == 0x00 && chainCommand());
+
+    //Send CMD38(0x00000000) to erase the blocks, and wait for the card to finish
+    success = success && (writeCommand(CMD38, 0x00000000) == 0x00 && waitReady(timeout));
+    deselect();
+
+    //Check the card status for erase errors
+    return success && validateWrite();
+}
+
+inline bool SDDisk::readBlock(char* buffer, unsigned int lba, bool verify)
+{
+    //Native transports handle checksums and retries themselves
+    if (m_Native != NULL)
+        return m_Native->read_blocks(buffer, lba, 1);
+
+    //Try to read the block as many times as the recovery policy allows
+    for (int f = 0; f < m_Recovery.retries; f++) {
+        //Select the card, and wait for ready
+        if(!select())
+            break;
+
+        //Send CMD17(block) to read a single block
+        if (writeCommand(CMD17, cardAddress(lba)) == 0x00) {
+            //Try to read the block (checking its CRC16 checksum if requested, sampled, or retrying), and deselect the card
+            bool success = readData(buffer, 512, verify || f > 0 || sampleRead());
+            deselect();
+
+            //Return if successful
+            if (success)
+                return true;
+        } else {
+            //The command failed, get out
+            break;
+        }
+    }
+
+    //The single block read failed
+    deselect();
+    return false;
+}
+
+inline bool SDDisk::readBlocks(char* buffer, unsigned int lba, unsigned int count)
+{
+    //Native transports handle checksums and retries themselves
+    if (m_Native != NULL)
+        return m_Native->read_blocks(buffer, lba, count);
+
+    //Try to read each block as many times as the recovery policy allows
+    for (int f = 0; f < m_Recovery.retries;) {
+        //Select the card, and wait for ready
+        if(!select())
+            break;
+
+        //Send CMD18(block) to read multiple blocks
+        if (writeCommand(CMD18, cardAddress(lba)) == 0x00) {
+            //Try to read all of the data blocks
+            const char* crcBuffer = NULL;
+            unsigned short crcExpected = 0;
+            do {
+                //Read the next block while verifying the CRC16 checksum of the previous block
+                unsigned short crc, crcActual;
+                bool success = readData(buffer, 512, &crc, crcBuffer, &crcActual);
+
+                //Roll back to the previous block if it was corrupted
+                if (crcBuffer != NULL && crcActual != crcExpected) {
+                    SD_STATS(m_Stats.read_crc_errors++);
+                    recordRetry(RETRY_READ_CRC);
+                    lba--;
+                    buffer -= 512;
+                    count++;
+                    f++;
+                    break;
+                }
+
+                //Break on errors
+                if (!success) {
+                    f++;
+                    break;
+                }
+
+                //Reset the retry counter once a block has been verified
+                if (crcBuffer != NULL || !crcEnabled())
+                    f = 0;
+
+                //Defer verification of this block until the next one is in flight (if enabled, and sampled or retrying)
+                crcBuffer = (crcEnabled() && (f > 0 || sampleRead())) ? buffer : NULL;
+                crcExpected = crc;
+
+                //Update the variables
+                lba++;
+                buffer += 512;
+            } while (--count);
+
+            //Verify the last block, and roll back to it if it was corrupted
+            if (count == 0 && crcBuffer != NULL && SDCRC::crc16(crcBuffer, 512) != crcExpected) {
+                SD_STATS(m_Stats.read_crc_errors++);
+                recordRetry(RETRY_READ_CRC);
+                lba--;
+                buffer -= 512;
+                count++;
+                f++;
+            }
+
+            //Send CMD12(0x00000000) to stop the transmission
+            if (writeCommand(CMD12, 0x00000000) != 0x00) {
+                //The command failed, get out
+                break;
+            }
+
+            //Deselect the card, and return if successful
+            deselect();
+            if (count == 0)
+                return true;
+        } else {
+            //The command failed, get out
+            break;
+        }
+    }
+
+    //The multiple block read failed
+    deselect();
+    return false;
+}
+
+inline bool SDDisk::writeBlock(const char* buffer, unsigned int lba, bool validate)
+{
+    //Native transports handle checksums and retries themselves, then apply the validation policy
+    if (m_Native != NULL)
+        return m_Native->write_blocks(buffer, lba, 1) && (!validate || checkValidation());
+
+    //Calculate the CRC16 checksum for the data block (if enabled)
+    unsigned short crc = crcEnabled() ? SDCRC::crc16(buffer, 512) : 0xFFFF;
+
+    //Try to write the block as many times as the recovery policy allows
+    for (int f = 0; f < m_Recovery.retries; f++) {
+        //Select the card, and wait for ready
+        if(!select())
+            break;
+
+        //Send CMD24(block) to write a single block
+        if (writeCommand(CMD24, cardAddress(lba)) == 0x00) {
+            //Try to write the block, and deselect the card
+            char token = writeData(buffer, 0xFE, crc, NULL, NULL);
+            deselect();
+
+            //Check the data response token
+            if (token == 0x0B) {
+                //A CRC error occured, try again
+                SD_STATS(m_Stats.write_crc_errors++);
+                recordRetry(RETRY_WRITE_CRC);
+                continue;
+            } else if (token != 0x05) {
+                //A write error occured, or the card never became ready for the block, get out
+                break;
+            }
+
+            //Verify that the programming was successful according to the validation policy if requested
+            if (validate && !checkValidation()) {
+                //Some manner of unrecoverable write error occured during programming, get out
+                break;
+            }
+
+            //The data was written successfully
+            return true;
+        } else {
+            //The command failed, get out
+            break;
+        }
+    }
+
+    //The single block write failed
+    deselect();
+    return false;
+}
+
+inline bool SDDisk::writeBlocks(const char* buffer, unsigned int lba, unsigned int count)
+{
+    //Native transports handle checksums and retries themselves, then apply the validation policy
+    if (m_Native != NULL)
+        return m_Native->write_blocks(buffer, lba, count) && checkValidation();
+
+    char token;
+    const char* currentBuffer = buffer;
+    unsigned int currentLba = lba;
+    int currentCount = count;
+
+    //Try to write each block as many times as the recovery policy allows
+    for (int f = 0; f < m_Recovery.retries;) {
+        //Select the card, and wait for ready
+        if(!select())
+            break;
+
+        //If this is an SD card, send ACMD23(count) to set the number of blocks to pre-erase, and chain CMD25 on to it
+        if (m_CardType != CARD_MMC) {
+            if (writeCommand(ACMD23, currentCount, NULL, true) != 0x00 || !chainCommand()) {
+                //The command failed, get out
+                break;
+            }
+        }
+
+        //Send CMD25(block) to write multiple blocks
+        if (writeCommand(CMD25, cardAddress(currentLba)) == 0x00) {
+            //Calculate the CRC16 checksum for the first data block (if enabled)
+            unsigned short crc = crcEnabled() ? SDCRC::crc16(currentBuffer, 512) : 0xFFFF;
+
+            //Try to write all of the data blocks
+            do {
+                //Write the next block while calculating the CRC16 checksum of the following block, and break on errors
+                unsigned short nextCrc = 0xFFFF;
+                token = writeData(currentBuffer, 0xFC, crc, (crcEnabled() && currentCount > 1) ? currentBuffer + 512 : NULL, &nextCrc);
+                if (token != 0x05) {
+                    f++;
+                    break;
+                }
+
+                //Update the variables
+                currentBuffer += 512;
+                crc = nextCrc;
+                f = 0;
+            } while (--currentCount);
+
+            //Wait for up to 500ms for the card to finish processing the last block
+            if (!waitReady(500))
+                break;
+
+            //Finalize the transmission
+            if (currentCount == 0) {
+                //Send the stop tran token, and verify that the programming was successful according to the validation policy
+                if (!stopTransmission()) {
+                    //Some manner of unrecoverable write error occured during programming, get out
+                    break;
+                }
+
+                //The data was written successfully
+                return true;
+            } else {
+                //Send CMD12(0x00000000) to abort the transmission
+                if (writeCommand(CMD12, 0x00000000) != 0x00) {
+                    //The command failed, get out
+                    break;
+                }
+
+                //Deselect the card
+                deselect();
+
+                //Check the error token
+                if (token == 0x0B) {
+                    SD_STATS(m_Stats.write_rollbacks++);
+                    recordRetry(RETRY_WRITE_CRC);
+
+                    //Determine the number of well written blocks if possible
+                    unsigned int writtenBlocks = 0;
+                    if (m_CardType != CARD_MMC && select()) {
+                        //Send ACMD22(0x00000000) to get the number of well written blocks
+                        if (writeCommand(ACMD22, 0x00000000, NULL, true) == 0x00) {
+                            //Read the data
+                            char acmdData[4];
+                            if (readData(acmdData, 4)) {
+                                //Extract the number of well written blocks
+                                writtenBlocks = acmdData[0] << 24;
+                                writtenBlocks |= acmdData[1] << 16;
+                                writtenBlocks |= acmdData[2] << 8;
+                                writtenBlocks |= acmdData[3];
+                            }
+                        }
+                        deselect();
+                    }
+
+                    //Roll back the variables based on the number of well written blocks
+                    currentBuffer = buffer + (writtenBlocks << 9);
+                    currentLba = lba + writtenBlocks;
+                    currentCount = count - writtenBlocks;
+
+                    //Try again
+                    continue;
+                } else {
+                    //A write error occured, get out
+                    break;
+                }
+            }
+        } else {
+            //The command failed, get out
+            break;
+        }
+    }
+
+    //The multiple block write failed
+    deselect();
+    return false;
+}
+
+inline bool SDDisk::validateWrite()
+{
+    //Ask a native transport to wait for programming and check the card status
+    if (m_Native != NULL)
+        return m_Native->status(500);
+
+    //Send CMD13(0x00000000) to read the card status
+    unsigned int resp;
+    if (commandTransaction(CMD13, 0x00000000, &resp) != 0x00 || resp != 0x00) {
+        //Some manner of unrecoverable write error occured during programming
+        return false;
+    }
+
+    //The programming was successful
+    return true;
+}
+
+bool SDDisk::checkValidation()
+{
+    //Apply the write validation policy to a completed write
+    if (validationMode() == VALIDATE_EACH) {
+        //Verify the write immediately
+        return validateWrite();
+    } else if (validationMode() == VALIDATE_EVERY_N) {
+        //Verify the writes once enough of them have accumulated, and remember any errors for disk_sync()
+        if (++m_PendingValidations >= m_ValidationInterval) {
+            m_PendingValidations = 0;
+            if (!validateWrite())
+                m_ValidationError = true;
+        }
+    } else if (validationMode() == VALIDATE_ON_SYNC) {
+        //Verify the write during disk_sync()
+        m_PendingValidations++;
+    }
+
+    //The write is considered successful for now
+    return true;
+}
+
+bool SDDisk::finishValidation()
+{
+    //Verify any writes that haven't been checked yet
+    if (m_PendingValidations > 0) {
+        m_PendingValidations = 0;
+        if (!validateWrite())
+            m_ValidationError = true;
+    }
+
+    //Report and clear any accumulated errors
+    bool success = !m_ValidationError;
+    m_ValidationError = false;
+    return success;
+}
+
+bool SDDisk::enableHighSpeedMode()
+{
+    //Send CMD6(0x00FFFFF1) to check whether high speed is supported in function group 1 without switching,
+    //unless this is a recognized card that we've already switched to high speed before
+    char status[64];
+    if (!(m_Recognized && m_Identity.high_speed)) {
+        if (!readRegister(CMD6, 0x00FFFFF1, status, 64) || !(status[13] & 0x02) || (status[16] & 0x0F) != 0x1)
+            return false;
+    }
+
+    //Send CMD6(0x80FFFFF1) to change the access mode to high speed
+    if (!readRegister(CMD6, 0x80FFFFF1, status, 64))
+        return false;
+
+    //Return whether or not the operation was successful
+    m_HighSpeed = ((status[16] & 0x0F) == 0x1);
+    return m_HighSpeed;
+}
+
+bool SDDisk::readRegister(unsigned char cmd, unsigned int arg, char* buffer, int length, bool app)
+{
+    //Try to read the register as many times as the recovery policy allows
+    for (int f = 0; f < m_Recovery.retries; f++) {
+        //Select the card, and wait for ready
+        if(!select())
+            break;
+
+        //Send the command, and read the data block that follows
+        if (writeCommand(cmd, arg, NULL, app) == 0x00) {
+            bool success = readData(buffer, length);
+            deselect();
+            if (success)
+                return true;
+        } else {
+            //The command failed, get out
+            break;
+        }
+    }
+
+    //The read operation failed every attempt
+    deselect();
+    return false;
+}
+
+bool SDDisk::recognizeCard()
+{
+    //Send CMD10(0x00000000) to read the CID register
+    char cid[16];
+    if (!readRegister(CMD10, 0x00000000, cid, 16)) {
+        //We can't tell which card this is, so forget the last one
+        m_Identity.type = CARD_NONE;
+        return false;
+    }
+
+    //Compare the CID register with the last card's
+    m_Recognized = (knownCard() && memcmp(cid, m_Identity.cid, 16) == 0);
+    if (!m_Recognized) {
+        //This is a different card, keep its CID until initialization completes
+        memcpy(m_Identity.cid, cid, 16);
+        m_Identity.type = CARD_UNKNOWN;
+    }
+
+    //Return whether or not this is the card we initialized last time
+    return m_Recognized;
+}
+
+inline bool SDDisk::knownCard()
+{
+    //Return whether or not the identity describes a fully initialized card
+    return (m_Identity.type != CARD_NONE && m_Identity.type != CARD_UNKNOWN);
+}
+
+bool SDDisk::readCardInfo()
+{
+    //Reuse the geometry of a recognized card
+    if (m_Recognized) {
+        m_Info = m_Identity.info;
+        return true;
+    }
+
+    //Send CMD9(0x00000000) to read the CSD register
+    char csd[16];
+    if (!readRegister(CMD9, 0x00000000, csd, 16))
+        return false;
+    m_Info.sectors = csdSectors(csd);
+    m_Info.erase_sectors = csdEraseSectors(csd, m_CardType == CARD_MMC);
+    m_Info.au_sectors = 0;
+    m_Info.speed_class = -1;
+
+    //Send ACMD13(0x00000000) to read the SD status for the allocation unit size and speed class
+    char status[64];
+    if (m_CardType != CARD_MMC && readRegister(ACMD13, 0x00000000, status, 64, true)) {
+        m_Info.au_sectors = statusAuSectors(status);
+        m_Info.speed_class = statusSpeedClass(status);
+    }
+
+    //The CSD register is required, but the SD status is optional
+    return true;
+}
+
+void SDDisk::rememberCard()
+{
+    //Give up if the card's CID couldn't be read
+    if (m_Identity.type == CARD_NONE)
+        return;
+
+    //Remember the card type, geometry and negotiated settings
+    m_Identity.type = m_CardType;
+    m_Identity.info = m_Info;
+    m_Identity.bus_frequency = m_BusFreq;
+    m_Identity.high_speed = m_HighSpeed || (m_Recognized && m_Identity.high_speed);
+    m_Identity.tuned = m_ClockTuning;
+}
+
+inline bool SDDisk::resumeCard()
+{
+    //Restart the idle timer, and wake the card if it's suspended
+    m_IdleTimer.reset();
+    m_IdleTimer.start();
+    return !m_Suspended || wakeCard();
+}
+
+bool SDDisk::wakeCard()
+{
+    unsigned int start = us_ticker_read();
+    m_Suspended = false;
+
+    //A card that kept its power is still initialized, otherwise switch it back on and initialize it again
+    bool success = true;
+    if (m_PoweredOff) {
+        m_Status |= STA_NOINIT;
+        success = !(disk_initialize() & STA_NOINIT);
+    }
+
+    //Update the wake latency statistics
+    unsigned int us = us_ticker_read() - start;
+    m_IdleStats.wakes++;
+    m_IdleStats.wake_us += us;
+    m_IdleStats.last_wake_us = us;
+    if (us > m_IdleStats.max_wake_us)
+        m_IdleStats.max_wake_us = us;
+
+    //Return success/failure
+    return success;
+}
+
+inline void SDDisk::checkIdle()
+{
+    //Get out if idle management is disabled, the card is already suspended, or it's been used recently
+    if (m_IdleTimeout == 0 || m_Suspended || m_IdleTimer.read_ms() < m_IdleTimeout)
+        return;
+
+    //Write everything back, keeping any errors for the next disk_sync() and trying again later
+    if (syncCard() != RES_OK) {
+        m_IdleError = true;
+        m_IdleTimer.reset();
+        return;
+    }
+
+    //Suspend the card
+    powerDown();
+}
+
+void SDDisk::powerDown()
+{
+    //Get out if the card is already suspended
+    if (m_Suspended)
+        return;
+
+    //Switch the card off if there's a power switch, otherwise leave it deselected in its standby state
+    if (m_Power != NULL) {
+        m_Power->write(!m_PowerOn);
+        m_PoweredOff = true;
+    }
+
+    //The card is suspended until the next disk operation
+    m_Suspended = true;
+    m_IdleTimer.stop();
+    m_IdleStats.suspends++;
+}
+
+bool SDDisk::openChecksums()
+{
+    //Forget the previous card's sidecar
+    m_SidecarActive = false;
+    m_SidecarTable = NO_TABLE;
+    m_SidecarDirty = false;
+    m_ScrubTable = NO_TABLE;
+
+    //Get out if checksums aren't used
+    if (!m_Checksums || m_Info.sectors < 2)
+        return true;
+
+    //Read the header from the last sector
+    if (m_SidecarBuffer == NULL)
+        m_SidecarBuffer = new char[512];
+    if (!cardRead(m_SidecarBuffer, m_Info.sectors - 1, 1))
+        return false;
+
+    //Use the sidecar if the header is valid and matches the card's size (the card just doesn't have one otherwise)
+    uint32_t data = sidecarData(m_Info.sectors);
+    if (getWord(m_SidecarBuffer) == SIDECAR_MAGIC && getWord(m_SidecarBuffer + 4) == data && getHalf(m_SidecarBuffer + 8) == SDCRC::crc16(m_SidecarBuffer, 8)) {
+        m_SidecarActive = true;
+        m_SidecarData = data;
+        if (m_ScrubNext >= data)
+            m_ScrubNext = 0;
+    }
+    return true;
+}
+
+bool SDDisk::loadChecksums(unsigned int table, bool overwrite)
+{
+    //Get out if the table sector is already loaded
+    if (table == m_SidecarTable)
+        return true;
+
+    //Write back the current table sector, then read the new one (unless all of its entries are about to be overwritten)
+    if (!flushChecksums())
+        return false;
+    if (overwrite) {
+        memset(m_SidecarBuffer, 0, 512);
+    } else if (!cardRead(m_SidecarBuffer, table, 1)) {
+        m_SidecarTable = NO_TABLE;
+        return false;
+    }
+    m_SidecarTable = table;
+    return true;
+}
+
+bool SDDisk::setChecksums(const char* buffer, unsigned int lba, unsigned int count)
+{
+    //Get out if there's no sidecar in use
+    if (!m_SidecarActive)
+        return true;
+
+    //Store the checksum of each data sector, or clear it if buffer is NULL
+    for (; count > 0 && lba < m_SidecarData; lba++, count--) {
+        bool overwrite = (buffer == NULL && (lba & 0xFF) == 0 && count >= 256);
+        if (!loadChecksums(m_SidecarData + (lba >> 8), overwrite))
+            return false;
+        putHalf(m_SidecarBuffer + ((lba & 0xFF) << 1), (buffer != NULL) ? sectorChecksum(buffer) : 0x0000);
+        m_SidecarDirty = true;
+        if (buffer != NULL)
+            buffer += 512;
+    }
+    return true;
+}
+
+bool SDDisk::flushChecksums()
+{
+    //Get out if the loaded table sector hasn't changed
+    if (!m_SidecarDirty)
+        return true;
+
+    //Write the table sector back, and forget the scrubber's stale copy of it
+    m_SidecarDirty = false;
+    if (m_ScrubTable == m_SidecarTable)
+        m_ScrubTable = NO_TABLE;
+    return cardWrite(m_SidecarBuffer, m_SidecarTable, 1);
+}
+
+int SDDisk::scrubSectors(unsigned int count)
+{
+    //Allocate the scrubber's data and table sector buffer on first use
+    if (m_ScrubBuffer == NULL) {
+        m_ScrubBuffer = new char[1024];
+        m_ScrubTable = NO_TABLE;
+    }
+
+    int mismatches = 0;
+    while (count-- > 0) {
+        //Move on to the next sector, starting a new pass once the end of the card is reached
+        unsigned int lba = m_ScrubNext;
+        if (++m_ScrubNext >= m_SidecarData) {
+            m_ScrubNext = 0;
+            m_ScrubStats.passes++;
+        }
+
+        //Skip sectors with writes still pending, since the card doesn't hold their checksummed contents yet
+        int slot = m_Cache.find(lba);
+        if (m_Ring.overlaps(lba, 1) || gatherOverlaps(lba, 1) || (slot >= 0 && m_Cache.dirty(slot))) {
+            m_ScrubStats.unchecked++;
+            continue;
+        }
+
+        //Look up the sector's checksum in the loaded table sector, or in the scrubber's own copy of its table sector
+        unsigned int table = m_SidecarData + (lba >> 8);
+        const char* entries = m_SidecarBuffer;
+        if (table != m_SidecarTable) {
+            entries = m_ScrubBuffer + 512;
+            if (table != m_ScrubTable) {
+                if (!cardRead(m_ScrubBuffer + 512, table, 1)) {
+                    m_ScrubTable = NO_TABLE;
+                    m_ScrubStats.read_errors++;
+                    continue;
+                }
+                m_ScrubTable = table;
+            }
+        }
+        unsigned short expected = getHalf(entries + ((lba & 0xFF) << 1));
+
+        //Skip sectors that haven't been written since the sidecar was created or they were erased
+        if (expected == 0x0000 || expected == 0xFFFF) {
+            m_ScrubStats.unchecked++;
+            continue;
+        }
+
+        //Read the sector, and read it again with its bus CRC checked before reporting a mismatch
+        bool success = cardRead(m_ScrubBuffer, lba, 1);
+        if (success && sectorChecksum(m_ScrubBuffer) != expected)
+            success = readBlock(m_ScrubBuffer, lba, true);
+        if (!success) {
+            m_ScrubStats.read_errors++;
+            continue;
+        }
+
+        //Compare the sector with its checksum
+        m_ScrubStats.sectors++;
+        if (sectorChecksum(m_ScrubBuffer) != expected) {
+            m_ScrubStats.mismatches++;
+            m_ScrubStats.last_mismatch = lba;
+            mismatches++;
+        }
+    }
+
+    //Return the number of mismatches
+    return mismatches;
+}
+
+#if SD_USE_RTOS
+void SDDisk::scrubTask()
+{
+    while (!m_ScrubStop) {
+        //Sleep until the next run, or until we're stopped
+        m_ScrubWake.wait(m_ScrubInterval);
+        if (m_ScrubStop)
+            break;
+
+        //Verify the next few sectors, leaving a suspended card asleep without counting as activity
+        SDScopedLock lock(m_Mutex);
+        if (!(m_Status & STA_NOINIT) && m_SidecarActive && !m_Suspended)
+            scrubSectors(m_ScrubCount);
+    }
+}
+
+void SDDisk::stopScrubber()
+{
+    //Get out if the scrubber thread isn't running
+    if (m_ScrubThread == NULL)
+        return;
+
+    //Wake the scrubber thread, and wait for it to exit
+    m_ScrubStop = true;
+    m_ScrubWake.release();
+    m_ScrubThread->join();
+    delete m_ScrubThread;
+    m_ScrubThread = NULL;
+}
+#endif
+
+void SDDisk::setBusFrequency(int hz)
+{
+    //Remember and apply the full speed SPI bus frequency
+    m_BusFreq = hz;
+    m_Spi->frequency(hz);
+}
+
+bool SDDisk::tuneRead(char* buffer)
+{
+    //Select the card, and wait for ready
+    if (!select())
+        return false;
+
+    //Send CMD17(0x00000000) to read sector 0 once, without any retries
+    bool success = (writeCommand(CMD17, 0x00000000) == 0x00 && readData(buffer, 512));
+    deselect();
+    return success;
+}
+
+bool SDDisk::tuneClock(int hz)
+{
+    //Finalize any open multiple block write session
+    if (!closeStream())
+        return false;
+
+    //Allocate the reference and test read buffers on first use, since tuning can run deep inside the flusher thread
+    if (m_TuneBuffer == NULL)
+        m_TuneBuffer = new char[1024];
+    char* reference = m_TuneBuffer;
+    char* buffer = m_TuneBuffer + 512;
+
+    //Read a reference copy of sector 0 at the initialization frequency
+    m_Spi->frequency(400000);
+    if (!readBlock(reference, 0, true)) {
+        setBusFrequency(hz);
+        return false;
+    }
+
+    //Step the frequency down by a quarter until 8 consecutive reads match the reference copy
+    for (; hz > 400000; hz -= hz / 4) {
+        m_Spi->frequency(hz);
+        bool stable = true;
+        for (int i = 0; i < 8 && stable; i++)
+            stable = (tuneRead(buffer) && memcmp(buffer, reference, 512) == 0);
+        if (stable)
+            break;
+    }
+
+    //Lock in the highest stable frequency, and restart the error rate monitoring
+    setBusFrequency((hz > 400000) ? hz : 400000);
+    m_TuneBlocks = 0;
+    m_TuneErrors = 0;
+    return true;
+}
+
+void SDDisk::recordRetry(SDDisk::RetryReason reason)
+{
+    //Count the error towards the error rate, and remember its cause
+    m_TuneErrors++;
+    m_RecoveryStats.last = reason;
+    switch (reason) {
+        case RETRY_COMMAND_CRC:
+            m_RecoveryStats.command_crc++;
+            break;
+        case RETRY_READ_CRC:
+            m_RecoveryStats.read_crc++;
+            break;
+        case RETRY_READ_TOKEN:
+            m_RecoveryStats.read_token++;
+            break;
+        case RETRY_WRITE_CRC:
+            m_RecoveryStats.write_crc++;
+            break;
+        default:
+            break;
+    }
+}
+
+inline unsigned int SDDisk::burstLimit()
+{
+    //Return the largest transfer the recovery policy allows (0 if unlimited)
+    return (m_BurstSteps > 0) ? (64 >> m_BurstSteps) : 0;
+}
+
+void SDDisk::checkErrorRate(unsigned int count)
+{
+    //Native transports handle their own error recovery
+    if (m_Native != NULL)
+        return;
+
+    //Evaluate the error rate once a window's worth of sectors has been transferred
+    m_TuneBlocks += count;
+    if (m_TuneBlocks < (unsigned int)m_Recovery.window)
+        return;
+
+    if (m_TuneErrors * m_Recovery.error_ratio > m_TuneBlocks) {
+        //The errors are persisting, so step down the bus frequency, remembering where it started
+        m_CleanBlocks = 0;
+        if (m_Recovery.step_clock) {
+            if (m_BusFreq > m_Recovery.min_frequency) {
+                if (m_ClockSteps++ == 0)
+                    m_ClockCeiling = m_BusFreq;
+                int hz = m_BusFreq - m_BusFreq / 4;
+                setBusFrequency((hz > m_Recovery.min_frequency) ? hz : m_Recovery.min_frequency);
+                m_RecoveryStats.clock_downs++;
+            }
+        } else if (m_ClockTuning && m_BusFreq > 400000) {
+            //Re-tune the clock, and keep the result for the next initialization
+            tuneClock(m_BusFreq - m_BusFreq / 4);
+            if (knownCard())
+                m_Identity.bus_frequency = m_BusFreq;
+            m_RecoveryStats.clock_downs++;
+        }
+
+        //Halve the largest transfer
+        if (m_Recovery.shrink_bursts && m_BurstSteps < 6) {
+            m_BurstSteps++;
+            m_RecoveryStats.burst_shrinks++;
+        }
+    } else if (m_TuneErrors == 0 && m_Recovery.clean_sectors > 0 && (m_ClockSteps > 0 || m_BurstSteps > 0)) {
+        //Undo one step once the card has been clean for long enough, raising the clock before growing the transfers
+        m_CleanBlocks += m_TuneBlocks;
+        if (m_CleanBlocks >= (unsigned int)m_Recovery.clean_sectors) {
+            m_CleanBlocks = 0;
+            if (m_ClockSteps > 0) {
+                int hz = (--m_ClockSteps == 0) ? m_ClockCeiling : m_BusFreq + m_BusFreq / 3;
+                setBusFrequency((hz < m_ClockCeiling) ? hz : m_ClockCeiling);
+                m_RecoveryStats.clock_ups++;
+            } else {
+                m_BurstSteps--;
+                m_RecoveryStats.burst_grows++;
+            }
+        }
+    } else {
+        //There were errors, so the clean period starts over
+        m_CleanBlocks = 0;
+    }
+
+    //Start the next window
+    m_TuneBlocks = 0;
+    m_TuneErrors = 0;
+}
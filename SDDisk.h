@@ -0,0 +1,1169 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_DISK_H
+#define SD_DISK_H
+
+#include "mbed.h"
+#include "SDConfig.h"
+#include "SDMutex.h"
+#include "SDSectorCache.h"
+#include "SDWriteRing.h"
+#include "SDStats.h"
+#include "SDTransport.h"
+#include "SDSharedBus.h"
+#include "SDNativeTransport.h"
+
+/** The maximum number of outstanding asynchronous requests
+ */
+#ifndef SD_ASYNC_QUEUE_SIZE
+#define SD_ASYNC_QUEUE_SIZE 4
+#endif
+
+/** The stack size of the write ring flusher thread in bytes (its writes can reach card initialization and clock tuning)
+ */
+#ifndef SD_RING_STACK_SIZE
+#define SD_RING_STACK_SIZE 2048
+#endif
+
+/** The stack size of the checksum scrubber thread in bytes (its reads can reach clock tuning)
+ */
+#ifndef SD_SCRUB_STACK_SIZE
+#define SD_SCRUB_STACK_SIZE 2048
+#endif
+
+/** SDDisk class.
+ *  Used for accessing SD/MMC cards as a raw array of 512B sectors, without a file system. SDFileSystem layers
+ *  FATFileSystem on top of it, and SDLogStore keeps an append-only log on it.
+ *
+ *  With SD_USE_RTOS, each disk operation (and each setter that talks to the card) holds a recursive mutex
+ *  for the duration of its transaction, so several threads can share one card. The card detect interrupt
+ *  only flags a removal: any wait in progress is abandoned, and the status is updated by the next call.
+ *
+ * Example:
+ * @code
+ * #include "mbed.h"
+ * #include "SDDisk.h"
+ *
+ * //Create an SDDisk object
+ * SDDisk disk(p5, p6, p7, p20);
+ * char buffer[4096];
+ *
+ * int main()
+ * {
+ *     //Initialize the card, and write 8 sectors to the end of it in one multiple block write
+ *     if (disk.disk_initialize() == 0) {
+ *         uint32_t sectors = disk.disk_sectors();
+ *         disk.disk_write((const uint8_t*)buffer, sectors - 8, 8);
+ *         disk.disk_sync();
+ *     }
+ *
+ *     //Write back any buffered sectors, and release the card
+ *     disk.disk_deinitialize();
+ * }
+ * @endcode
+ */
+class SDDisk
+{
+public:
+    /** Represents the different card detect switch types
+     */
+    enum SwitchType {
+        SWITCH_NONE,    /**< No card detect switch (assumes socket is always occupied) */
+        SWITCH_POS_NO,  /**< Switch shorts to VDD when the socket is occupied (positive logic, normally open) */
+        SWITCH_POS_NC,  /**< Switch shorts to VDD when the socket is empty (positive logic, normally closed) */
+        SWITCH_NEG_NO,  /**< Switch shorts to GND when the socket is occupied (negative logic, normally open) */
+        SWITCH_NEG_NC   /**< Switch shorts to GND when the socket is empty (negative logic, normally closed) */
+    };
+
+    /** Represents the different write validation policies
+     */
+    enum ValidationMode {
+        VALIDATE_NONE,      /**< Data writes are not verified */
+        VALIDATE_EACH,      /**< Every data write is verified using CMD13 before returning */
+        VALIDATE_ON_SYNC,   /**< Data writes are verified using a single CMD13 during disk_sync() */
+        VALIDATE_EVERY_N    /**< Data writes are verified using CMD13 after every N writes, and during disk_sync() */
+    };
+
+    /** Represents the different ways of waiting for the card
+     */
+    enum WaitMode {
+        WAIT_SPIN,      /**< Poll the card continuously (lowest latency) */
+        WAIT_BACKOFF,   /**< Poll the card with an exponentially increasing wait_us() delay between polls */
+        WAIT_YIELD      /**< Like WAIT_BACKOFF, but yield to other threads between polls (requires SD_USE_RTOS) */
+    };
+
+    /** Represents the accumulated timing of one kind of card wait
+     */
+    struct WaitStats {
+        unsigned int count;     /**< The number of waits */
+        unsigned int total_us;  /**< The total time spent waiting in microseconds */
+        unsigned int max_us;    /**< The longest wait in microseconds */
+        unsigned int timeouts;  /**< The number of waits that timed out */
+    };
+
+    /** Represents the accumulated behaviour of the write ring
+     */
+    struct RingStats {
+        unsigned int high_water;    /**< The most sectors queued at once */
+        unsigned int bursts;        /**< The number of runs written from the ring */
+        unsigned int stalls;        /**< The number of writes that found the ring full */
+        unsigned int stall_us;      /**< The total time writes spent waiting for room in microseconds */
+        unsigned int max_stall_us;  /**< The longest wait for room in microseconds */
+    };
+
+    /** Represents the accumulated behaviour of idle management
+     */
+    struct IdleStats {
+        unsigned int suspends;      /**< The number of times the card was suspended */
+        unsigned int wakes;         /**< The number of times the card was woken for a disk operation */
+        unsigned int wake_us;       /**< The total time spent waking the card in microseconds */
+        unsigned int max_wake_us;   /**< The longest wake in microseconds */
+        unsigned int last_wake_us;  /**< The most recent wake in microseconds */
+    };
+
+    /** Represents the accumulated behaviour of the checksum scrubber
+     */
+    struct ScrubStats {
+        unsigned int sectors;       /**< The number of sectors verified against their checksums */
+        unsigned int unchecked;     /**< The number of sectors skipped (no checksum yet, or writes still pending) */
+        unsigned int mismatches;    /**< The number of sectors that didn't match their checksums */
+        unsigned int read_errors;   /**< The number of sectors that couldn't be read */
+        unsigned int passes;        /**< The number of complete passes over the card */
+        unsigned int last_mismatch; /**< The most recent sector that didn't match its checksum */
+    };
+
+    /** Represents the causes of retried commands and transfers
+     */
+    enum RetryReason {
+        RETRY_NONE,         /**< Nothing has been retried */
+        RETRY_COMMAND_CRC,  /**< The card reported a CRC error in a command */
+        RETRY_READ_CRC,     /**< A data block failed its CRC16 check */
+        RETRY_READ_TOKEN,   /**< A data block's start token didn't arrive, or was an error token */
+        RETRY_WRITE_CRC     /**< The card reported a CRC error in a data block */
+    };
+
+    /** Represents the error recovery policy
+     */
+    struct RecoveryPolicy {
+        int retries;            /**< The number of attempts for each command and transfer (defaults to 3) */
+        int window;             /**< The number of sectors between error rate checks (defaults to 256) */
+        int error_ratio;        /**< Errors persist once more than 1 in this many sectors needed a retry in a window (defaults to 64) */
+        bool step_clock;        /**< Whether to step the bus frequency down by a quarter while errors persist (defaults to false) */
+        bool shrink_bursts;     /**< Whether to halve the largest transfer (from 32 sectors down to 1) while errors persist (defaults to false) */
+        int clean_sectors;      /**< The number of error free sectors before one step is undone (0 to never undo, defaults to 4096) */
+        int min_frequency;      /**< The lowest bus frequency to step down to in Hz (defaults to 400kHz) */
+    };
+
+    /** Represents the accumulated behaviour of error recovery
+     */
+    struct RecoveryStats {
+        unsigned int command_crc;   /**< The number of command CRC errors */
+        unsigned int read_crc;      /**< The number of data block CRC errors during reads */
+        unsigned int read_token;    /**< The number of missing or error start block tokens during reads */
+        unsigned int write_crc;     /**< The number of data block CRC errors during writes */
+        unsigned int clock_downs;   /**< The number of times the bus frequency was stepped down */
+        unsigned int clock_ups;     /**< The number of times the bus frequency was stepped back up */
+        unsigned int burst_shrinks; /**< The number of times the largest transfer was halved */
+        unsigned int burst_grows;   /**< The number of times the largest transfer was doubled again */
+        SDDisk::RetryReason last;   /**< The cause of the most recent retry */
+    };
+
+    /** Represents the different SD/MMC card types
+     */
+    enum CardType {
+        CARD_NONE,      /**< No card is present */
+        CARD_MMC,       /**< MMC card */
+        CARD_SD,        /**< Standard capacity SD card */
+        CARD_SDHC,      /**< High capacity SD card */
+        CARD_UNKNOWN    /**< Unknown or unsupported card */
+    };
+
+    /** Represents the geometry and performance details of a card
+     */
+    struct CardInfo {
+        uint32_t sectors;       /**< The capacity in 512B sectors */
+        uint32_t erase_sectors; /**< The smallest erasable unit in sectors */
+        uint32_t au_sectors;    /**< The allocation unit size in sectors (0 if unknown), the best alignment for large writes and erases */
+        int speed_class;        /**< The speed class (0, 2, 4, 6 or 10), or -1 if unknown */
+    };
+
+    /** Represents the identity and negotiated settings of the last card initialized
+     */
+    struct CardIdentity {
+        char cid[16];          /**< The CID register */
+        SDDisk::CardInfo info; /**< The card geometry from the CSD register and SD status */
+        SDDisk::CardType type; /**< The card type (CARD_NONE or CARD_UNKNOWN if the identity isn't valid) */
+        int bus_frequency;     /**< The SPI bus frequency in Hz */
+        bool high_speed;       /**< Whether or not the card has been switched to high speed mode */
+        bool tuned;            /**< Whether or not bus_frequency was found by clock tuning */
+    };
+
+    /** Create a disk for accessing SD/MMC cards via SPI
+     *
+     * @param mosi The SPI data out pin.
+     * @param miso The SPI data in pin.
+     * @param sclk The SPI clock pin.
+     * @param cs The SPI chip select pin.
+     * @param cd The card detect pin.
+     * @param cdtype The type of card detect switch.
+     * @param hz The SPI bus frequency (defaults to 1MHz).
+     */
+    SDDisk(PinName mosi, PinName miso, PinName sclk, PinName cs, PinName cd = NC, SwitchType cdtype = SWITCH_NONE, int hz = 1000000);
+
+    /** Create a disk for accessing SD/MMC cards on an SPI bus shared with other cards
+     *
+     * @param bus The shared SPI bus (must outlive the disk).
+     * @param cs The SPI chip select pin for this card.
+     * @param cd The card detect pin.
+     * @param cdtype The type of card detect switch.
+     * @param hz The SPI bus frequency (defaults to 1MHz).
+     */
+    SDDisk(SDSharedBus& bus, PinName cs, PinName cd = NC, SwitchType cdtype = SWITCH_NONE, int hz = 1000000);
+
+    /** Create a disk for accessing SD/MMC cards via a custom SPI-mode transport
+     *
+     * @param transport The transport used to communicate with the card (must outlive the disk).
+     * @param cd The card detect pin.
+     * @param cdtype The type of card detect switch.
+     * @param hz The bus frequency (defaults to 1MHz).
+     */
+    SDDisk(SDTransport& transport, PinName cd = NC, SwitchType cdtype = SWITCH_NONE, int hz = 1000000);
+
+    /** Create a disk for accessing SD cards via a native SD bus transport (such as SDIOTransport)
+     *
+     * @param transport The transport used to communicate with the card (must outlive the disk).
+     * @param cd The card detect pin.
+     * @param cdtype The type of card detect switch.
+     * @param hz The maximum bus frequency (defaults to 24MHz).
+     *
+     * @note The SPI mode options (crc(), large_frames(), dma(), write_streaming() and command_batching()) have no effect, since
+     *       the host controller handles checksums and data transfers itself.
+     */
+    SDDisk(SDNativeTransport& transport, PinName cd = NC, SwitchType cdtype = SWITCH_NONE, int hz = 24000000);
+
+    /** Destroy the disk, releasing any buffers
+     */
+    virtual ~SDDisk();
+
+    /** Determine whether or not a card is present
+     *
+     * @returns
+     *   'true' if a card is present,
+     *   'false' if no card is present.
+     */
+    bool card_present();
+
+    /** Get the detected SD/MMC card type
+     *
+     * @returns The detected card type as a CardType enum.
+     *
+     * @note Valid after the card has been initialized.
+     */
+    SDDisk::CardType card_type();
+
+    /** Get the identity of the last card initialized
+     *
+     * @returns The card's CID and CSD registers, type, and negotiated bus settings.
+     *
+     * @note Save this across resets (in backup RAM, for example) and restore it with card_identity(identity)
+     *       to speed up the first initialization after a brown-out.
+     */
+    SDDisk::CardIdentity card_identity();
+
+    /** Get the geometry and performance details of the card
+     *
+     * @returns The card's capacity, erase unit, allocation unit and speed class, parsed once during initialization.
+     *
+     * @note Valid after the card has been initialized. The allocation unit and speed class come from
+     *       the SD status (ACMD13), which isn't available for MMC cards or native transports.
+     */
+    SDDisk::CardInfo card_info();
+
+    /** Set the identity of the last card initialized
+     *
+     * @param identity A card identity previously returned by card_identity().
+     *
+     * @note If the next card initialized has the same CID, the OCR read, CMD6 high speed query (if it succeeded),
+     *       clock tuning, and CSD and SD status reads are skipped, and the saved results are used instead. Any other card is initialized
+     *       normally. Once a card is removed, the next disk_initialize() (called by SDFileSystem on file access) also
+     *       initializes a re-inserted card this way.
+     */
+    void card_identity(const SDDisk::CardIdentity& identity);
+
+    /** Get the requested SPI bus frequency
+     *
+     * @returns The requested SPI bus frequency in Hz.
+     */
+    int frequency();
+
+    /** Set the requested SPI bus frequency
+     *
+     * @param hz The SPI bus frequency in Hz.
+     *
+     * @note Takes effect the next time the card is initialized, where it's limited to the maximum
+     *       supported by the detected card type.
+     */
+    void frequency(int hz);
+
+    /** Get the SPI bus frequency currently in use
+     *
+     * @returns The SPI bus frequency in Hz chosen during initialization and clock tuning (0 if not initialized).
+     */
+    int bus_frequency();
+
+    /** Get whether or not the card was switched to high speed mode (up to 50MHz)
+     *
+     * @returns
+     *   'true' if CMD6 reported high speed support and the switch succeeded,
+     *   'false' if the card is running in default speed mode.
+     */
+    bool high_speed();
+
+    /** Get whether or not automatic clock tuning is enabled
+     *
+     * @returns
+     *   'true' if the SPI bus frequency is tuned during initialization and when CRC errors climb,
+     *   'false' if the SPI bus frequency is only limited by the card type.
+     */
+    bool clock_tuning();
+
+    /** Set whether or not automatic clock tuning is enabled
+     *
+     * @param enabled Whether or not to tune the SPI bus frequency.
+     *
+     * @note When enabled, initialization steps the frequency down from frequency() until repeated reads of
+     *       sector 0 match a reference copy read at 400kHz (and pass CRC if enabled), and locks in the highest
+     *       stable frequency. If errors persist at runtime (see RecoveryPolicy), the frequency is re-tuned and
+     *       stepped down again, unless the recovery policy steps the clock itself. Takes effect the next time
+     *       the card is initialized.
+     */
+    void clock_tuning(bool enabled);
+
+    /** Get the error recovery policy
+     *
+     * @returns The current error recovery policy.
+     */
+    SDDisk::RecoveryPolicy recovery_policy();
+
+    /** Set the error recovery policy
+     *
+     * @param policy The new error recovery policy.
+     *
+     * @note Commands and transfers are retried up to policy.retries times. Every sector transferred counts
+     *       towards a window, and once the window is complete its error rate decides the next step: if errors
+     *       persist, the bus frequency and the largest transfer are stepped down (if enabled). After
+     *       policy.clean_sectors without errors one step is undone, raising the clock before growing the
+     *       transfers. The steps are temporary, and start over when the card is initialized. Native
+     *       transports handle retries themselves, so the policy only applies in SPI mode.
+     */
+    void recovery_policy(const SDDisk::RecoveryPolicy& policy);
+
+    /** Get the accumulated behaviour of error recovery
+     *
+     * @returns The number of retries by cause, and the number of recovery steps taken.
+     */
+    SDDisk::RecoveryStats recovery_stats();
+
+    /** Reset the accumulated behaviour of error recovery
+     */
+    void reset_recovery_stats();
+
+    /** Get whether or not CRC is enabled for commands and data
+     *
+     * @returns
+     *   'true' if CRC is enabled for commands and data,
+     *   'false' if CRC is disabled for commands and data.
+     */
+    bool crc();
+
+    /** Set whether or not CRC is enabled for commands and data
+     *
+     * @param enabled Whether or not to enable CRC for commands and data.
+     *
+     * @note Ignored if CRC is fixed at compile time (SD_FIXED_CRC).
+     */
+    void crc(bool enabled);
+
+    /** Get how often the CRC16 of read data blocks is checked
+     *
+     * @returns The number of data blocks per check (1 if every block is checked).
+     */
+    int crc_sampling();
+
+    /** Set how often the CRC16 of read data blocks is checked
+     *
+     * @param interval The number of data blocks per check (1 to check every block, the default).
+     *
+     * @note The card still checks command and write CRCs, and every block is checked once a read has been
+     *       retried, so sampling only skips the CRC16 calculation on a healthy bus. Has no effect while CRC
+     *       is disabled. Use checksums() to catch the corruption that sampling lets through.
+     */
+    void crc_sampling(int interval);
+
+    /** Get whether or not 16-bit frames are enabled for data read/write operations
+     *
+     * @returns
+     *   'true' if 16-bit frames will be used during data read/write operations,
+     *   'false' if 8-bit frames will be used during data read/write operations.
+     */
+    bool large_frames();
+
+    /** Set whether or not 16-bit frames are enabled for data read/write operations
+     *
+     * @param enabled Whether or not 16-bit frames are enabled for data read/write operations.
+     *
+     * @note Word-aligned buffers bypass the frame loop entirely if the transport supports block transfers
+     *       (SDTransport::transfer()), so 16-bit frames only speed up unaligned buffers on those transports.
+     *       Ignored if the frame width is fixed at compile time (SD_FIXED_LARGE_FRAMES).
+     */
+    void large_frames(bool enabled);
+
+    /** Get whether or not write validation is enabled for data write operations
+     *
+     * @returns
+     *   'true' if data writes will be verified using CMD13,
+     *   'false' if data writes will not be verified.
+     */
+    bool write_validation();
+
+    /** Set whether or not write validation is enabled for data write operations
+     *
+     * @param enabled Whether or not write validation is enabled for data write operations.
+     *
+     * @note Equivalent to validation_mode(VALIDATE_EACH) or validation_mode(VALIDATE_NONE).
+     */
+    void write_validation(bool enabled);
+
+    /** Get the write validation policy
+     *
+     * @returns The current write validation policy as a ValidationMode enum.
+     */
+    SDDisk::ValidationMode validation_mode();
+
+    /** Set the write validation policy
+     *
+     * @param mode The write validation policy.
+     * @param interval The number of writes between checks for VALIDATE_EVERY_N.
+     *
+     * @note The card latches programming errors until CMD13 reads them, so deferred checks still catch
+     *       every failed write. Errors found by deferred checks are reported by the next disk_sync().
+     *       The mode is ignored if the policy is fixed at compile time (SD_FIXED_VALIDATION).
+     */
+    void validation_mode(SDDisk::ValidationMode mode, int interval = 8);
+
+    /** Get whether or not DMA is used for data block transfers
+     *
+     * @returns
+     *   'true' if data blocks will be transferred using SPI::transfer() (DMA where available),
+     *   'false' if data blocks will be transferred using SPI::write().
+     *
+     * @note Always 'false' on targets without asynchronous SPI support (DEVICE_SPI_ASYNCH).
+     */
+    bool dma();
+
+    /** Set whether or not DMA is used for data block transfers
+     *
+     * @param enabled Whether or not to use DMA for data block transfers.
+     *
+     * @note Ignored on targets without asynchronous SPI support (DEVICE_SPI_ASYNCH).
+     */
+    void dma(bool enabled);
+
+    /** Get how the card is polled while it's busy or preparing data
+     *
+     * @returns The current wait mode as a WaitMode enum.
+     */
+    SDDisk::WaitMode wait_mode();
+
+    /** Set how the card is polled while it's busy or preparing data
+     *
+     * @param mode The wait mode.
+     * @param max_delay_us The longest delay between polls in microseconds for WAIT_BACKOFF and WAIT_YIELD.
+     *
+     * @note The first few polls of every wait always spin, so short waits aren't penalized. With WAIT_YIELD,
+     *       delays shorter than 1ms call Thread::yield(), and longer delays sleep the calling thread.
+     *       Cards on an SDSharedBus are deselected during the delays, so WAIT_BACKOFF or WAIT_YIELD lets the
+     *       other cards use the bus while this one is busy programming.
+     */
+    void wait_mode(SDDisk::WaitMode mode, int max_delay_us = 1000);
+
+    /** Get the timing of waits for the card to finish programming (the busy waits in select() and writeData())
+     *
+     * @returns The accumulated busy wait timing.
+     */
+    SDDisk::WaitStats busy_wait_stats();
+
+    /** Get the timing of waits for a start block token from the card
+     *
+     * @returns The accumulated token wait timing.
+     */
+    SDDisk::WaitStats token_wait_stats();
+
+    /** Reset the accumulated wait timing
+     */
+    void reset_wait_stats();
+
+#if SD_ENABLE_STATS
+    /** Get the performance counters collected since the last reset (only available if SD_ENABLE_STATS is set)
+     *
+     * @returns A reference to the performance counters.
+     */
+    const SDStats& stats();
+
+    /** Reset the performance counters (only available if SD_ENABLE_STATS is set)
+     */
+    void reset_stats();
+#endif
+
+    /** Get the number of sectors held by the write-back sector cache
+     *
+     * @returns The number of 512B sectors cached in RAM (0 if the cache is disabled).
+     */
+    int cache_size();
+
+    /** Set the number of sectors held by the write-back sector cache
+     *
+     * @param sectors The number of 512B sectors to cache in RAM (0 to disable the cache).
+     *
+     * @note Single sector reads and writes are served from the cache, and dirty sectors are
+     *       written back on eviction, disk_sync(), and disk_deinitialize(). Resizing the cache writes back
+     *       any dirty sectors first.
+     */
+    void cache_size(int sectors);
+
+    /** Get the size of the write gather buffer
+     *
+     * @returns The number of contiguous single sector writes that can be gathered (0 if disabled).
+     */
+    int write_gather();
+
+    /** Set the size of the write gather buffer
+     *
+     * @param sectors The number of contiguous single sector writes to gather into one multiple block write (0 to disable).
+     *
+     * @note Gathered sectors are written when a non-contiguous write arrives, when the buffer fills, when a read
+     *       overlaps them, on disk_sync() and disk_deinitialize(), or once they're older than write_gather_timeout().
+     *       Write errors for gathered sectors are reported by the call that flushes them.
+     */
+    void write_gather(int sectors);
+
+    /** Get the maximum age of gathered writes
+     *
+     * @returns The number of milliseconds gathered sectors may wait before being written.
+     */
+    int write_gather_timeout();
+
+    /** Set the maximum age of gathered writes
+     *
+     * @param ms The number of milliseconds gathered sectors may wait before being written.
+     *
+     * @note The age is checked on each disk operation, disk_status() call, and async_poll() call.
+     */
+    void write_gather_timeout(int ms);
+
+    /** Get the size of the write ring
+     *
+     * @returns The number of sectors the write ring can queue (0 if disabled).
+     */
+    int write_ring();
+
+    /** Set the size of the write ring
+     *
+     * @param sectors The number of sectors disk_write() may queue in RAM before it has to wait for the card (0 to disable).
+     *
+     * @note While the ring is enabled, disk_write() copies the sectors into the ring and returns without
+     *       locking the card, and a flusher thread writes the runs of consecutive sectors through the cache
+     *       and write gather buffer in large bursts. Once the ring is full, disk_write() blocks until the oldest run has
+     *       been written. Reads, erases and asynchronous requests overlapping queued sectors write the ring first, and
+     *       disk_sync() and disk_deinitialize() write all of it. Errors writing queued sectors are reported by the next
+     *       disk_write() or disk_sync(). Without SD_USE_RTOS there's no flusher thread, so the ring is only
+     *       written once it fills, and just gathers writes into larger bursts. Resizing the ring writes any
+     *       queued sectors first.
+     */
+    void write_ring(int sectors);
+
+    /** Get the accumulated behaviour of the write ring
+     *
+     * @returns The write ring's high-water mark, burst count and back-pressure stalls.
+     */
+    SDDisk::RingStats ring_stats();
+
+    /** Reset the accumulated behaviour of the write ring
+     */
+    void reset_ring_stats();
+
+    /** Get the size of the read-ahead buffer
+     *
+     * @returns The maximum number of sectors prefetched during sequential reads (0 if disabled).
+     */
+    int read_ahead();
+
+    /** Set the size of the read-ahead buffer
+     *
+     * @param sectors The maximum number of sectors to prefetch during sequential reads (0 to disable).
+     *
+     * @note Once a read continues where the previous one ended, sectors are prefetched in a single
+     *       multiple block read, doubling the window on each further sequential miss. Non-sequential
+     *       reads reset the window, and any write discards the prefetched sectors.
+     */
+    void read_ahead(int sectors);
+
+    /** Get whether or not multiple block write sessions are kept open between writes
+     *
+     * @returns
+     *   'true' if CMD25 sessions stay open while writes continue on to the next sector,
+     *   'false' if every write is finalized before returning.
+     */
+    bool write_streaming();
+
+    /** Set whether or not multiple block write sessions are kept open between writes
+     *
+     * @param enabled Whether or not to keep CMD25 sessions open between writes.
+     *
+     * @note The session is finalized with the stop tran token when a write doesn't follow on from it,
+     *       on any read or other command, and on disk_sync() and disk_deinitialize(). ACMD23 pre-erase isn't used
+     *       while streaming, and write validation (if enabled) is deferred until the session is finalized.
+     */
+    void write_streaming(bool enabled);
+
+    /** Get whether or not writes are aligned to allocation unit boundaries
+     *
+     * @returns
+     *   'true' if multiple block writes, gathered runs and streaming sessions are split at allocation unit boundaries,
+     *   'false' if writes are sent to the card as they are.
+     */
+    bool au_alignment();
+
+    /** Set whether or not writes are aligned to allocation unit boundaries
+     *
+     * @param enabled Whether or not to split writes at allocation unit boundaries.
+     *
+     * @note Keeping each CMD25 burst (and its ACMD23 pre-erase count) inside one allocation unit avoids
+     *       the card juggling two open units at once. Has no effect if the allocation unit size is unknown
+     *       (see card_info()).
+     */
+    void au_alignment(bool enabled);
+
+    /** Get whether or not back-to-back commands are batched under a single chip select
+     *
+     * @returns
+     *   'true' if chained commands keep the card selected between them,
+     *   'false' if the card is deselected and reselected between every command.
+     */
+    bool command_batching();
+
+    /** Set whether or not back-to-back commands are batched under a single chip select
+     *
+     * @param enabled Whether or not to keep the card selected between chained commands.
+     *
+     * @note Batching covers CMD55 and its ACMD, ACMD23 and CMD25, CMD25 and the data blocks that follow it,
+     *       CMD32 and CMD33, and the stop tran token and the CMD13 of an immediate write validation. This saves
+     *       the deselect and reselect bytes and a ready poll per command. Disable it for cards that need
+     *       /CS toggled between commands.
+     */
+    void command_batching(bool enabled);
+
+    /** Get the idle timeout
+     *
+     * @returns The number of milliseconds without card access before the card is suspended (0 if disabled).
+     */
+    int idle_timeout();
+
+    /** Set the idle timeout
+     *
+     * @param ms The number of milliseconds without card access before the card is suspended (0 to disable).
+     *
+     * @note The timeout is checked on each disk_status() call and async_poll() call, and by the write ring's
+     *       flusher thread. Errors writing back sectors before an automatic suspend are reported by the next
+     *       disk_sync().
+     */
+    void idle_timeout(int ms);
+
+    /** Set the pin that switches the card's power
+     *
+     * @param pin The power switch control pin (the card is powered immediately).
+     * @param active_high Whether the pin is driven high (true) or low (false) to power the card.
+     * @param ramp_ms The number of milliseconds to let the supply settle after switching the card back on.
+     *
+     * @note Without a power switch, a suspended card is left deselected in its standby state and wakes instantly.
+     *       With one, it's switched off and re-initialized on wake. A recognized card skips reading its
+     *       registers, switching to high speed mode and clock tuning, but the ACMD41 power-up still takes
+     *       tens of milliseconds. Make sure the bus lines don't back-power the card while it's switched off.
+     */
+    void power_pin(PinName pin, bool active_high = true, int ramp_ms = 5);
+
+    /** Write back any queued, cached and gathered sectors, then suspend the card until the next disk operation
+     *
+     * @returns The DRESULT code (RES_OK if the card was suspended).
+     */
+    int suspend();
+
+    /** Get whether or not the card is suspended
+     *
+     * @returns
+     *   'true' if the card is suspended, and the next disk operation will wake it,
+     *   'false' if the card is active.
+     */
+    bool suspended();
+
+    /** Get the accumulated behaviour of idle management
+     *
+     * @returns The suspend and wake counts, and the wake latency.
+     */
+    SDDisk::IdleStats idle_stats();
+
+    /** Reset the accumulated behaviour of idle management
+     */
+    void reset_idle_stats();
+
+    /** Get whether or not sector checksums are used
+     *
+     * @returns
+     *   'true' if the card's checksum sidecar is used when present,
+     *   'false' if sector checksums are ignored.
+     */
+    bool checksums();
+
+    /** Set whether or not sector checksums are used
+     *
+     * @param enabled Whether or not to use the card's checksum sidecar when present.
+     *
+     * @note Takes effect the next time the card is initialized.
+     */
+    void checksums(bool enabled);
+
+    /** Reserve the end of the card for a checksum sidecar, and start using it
+     *
+     * @returns The DRESULT code (RES_OK if the sidecar was created).
+     *
+     * @note The sidecar holds a CRC16 for every data sector (1 table sector per 256 sectors), followed by a
+     *       header in the last sector, and disk_sectors() shrinks to the data sectors while it's in use, so
+     *       create it before formatting the card. Every sector starts out with no checksum until it's written.
+     *       Checksums are written back during disk_sync(), so sectors written after the last sync may not
+     *       match their checksums after a power loss.
+     */
+    int format_checksums();
+
+    /** Verify the next few sectors against their checksums, starting a new pass once the end of the card is reached
+     *
+     * @param count The number of sectors to verify.
+     *
+     * @returns The number of sectors that didn't match their checksums, or -1 if the card isn't initialized
+     *          or doesn't have a checksum sidecar in use.
+     *
+     * @note Mismatches are read again with the bus CRC checked before they're reported.
+     */
+    int scrub(uint32_t count);
+
+    /** Verify sectors against their checksums in the background
+     *
+     * @param interval_ms The time between runs in milliseconds (0 to stop the scrubber).
+     * @param sectors The number of sectors to verify during each run.
+     *
+     * @note Requires SD_USE_RTOS (call scrub() periodically otherwise). The scrubber leaves a suspended card
+     *       asleep, and doesn't count as card activity for idle_timeout().
+     */
+    void scrubber(int interval_ms, int sectors = 8);
+
+    /** Get the accumulated behaviour of the checksum scrubber
+     *
+     * @returns The number of sectors verified and skipped, and the mismatches found.
+     */
+    SDDisk::ScrubStats scrub_stats();
+
+    /** Reset the accumulated behaviour of the checksum scrubber
+     */
+    void reset_scrub_stats();
+
+    /** Erase a range of sectors (CMD32, CMD33 and CMD38, or CMD35, CMD36 and CMD38 for MMC)
+     *
+     * @param sector The first sector to erase.
+     * @param count The number of sectors to erase.
+     *
+     * @returns The DRESULT code (RES_OK if the sectors were erased).
+     *
+     * @note Erased sectors read back as all 0x00 or all 0xFF, depending on the card. Later writes to them
+     *       don't have to wait for the card to erase the flash first. Cached and gathered copies of the
+     *       sectors are written or discarded first, and the wait allows 250ms per allocation unit.
+     */
+    int erase(uint32_t sector, uint32_t count);
+
+    /** Tell the card that a range of sectors no longer holds useful data
+     *
+     * @param sector The first sector of the range.
+     * @param count The number of sectors in the range.
+     *
+     * @returns The DRESULT code.
+     *
+     * @note The allocation units (or erase units, if the allocation unit size is unknown) wholly inside the range
+     *       are erased ahead of time, and partial units at either end are left alone. Call this from
+     *       disk_ioctl(CTRL_TRIM) when FatFs is built with _USE_TRIM, since the FATFileSystem library
+     *       doesn't forward trim requests itself.
+     */
+    int disk_trim(uint32_t sector, uint32_t count);
+
+    /** Queue an asynchronous read of one or more sectors
+     *
+     * @param buffer The buffer to read the sectors into (must remain valid until the callback fires).
+     * @param sector The first sector to read.
+     * @param count The number of sectors to read.
+     * @param callback The callback to invoke with the DRESULT code when the request completes.
+     *
+     * @returns
+     *   'true' if the request was queued,
+     *   'false' if the card isn't initialized or the queue is full.
+     *
+     * @note The request is carried out by subsequent calls to async_poll().
+     */
+    bool read_async(uint8_t* buffer, uint32_t sector, uint32_t count, Callback<void(int)> callback);
+
+    /** Queue an asynchronous write of one or more sectors
+     *
+     * @param buffer The buffer to write the sectors from (must remain valid until the callback fires).
+     * @param sector The first sector to write.
+     * @param count The number of sectors to write.
+     * @param callback The callback to invoke with the DRESULT code when the request completes.
+     *
+     * @returns
+     *   'true' if the request was queued,
+     *   'false' if the card isn't initialized, is write protected, or the queue is full.
+     *
+     * @note The request is carried out by subsequent calls to async_poll().
+     */
+    bool write_async(const uint8_t* buffer, uint32_t sector, uint32_t count, Callback<void(int)> callback);
+
+    /** Queue an asynchronous wait for the end of any internal write processes
+     *
+     * @param callback The callback to invoke with the DRESULT code when the card is idle.
+     *
+     * @returns
+     *   'true' if the request was queued,
+     *   'false' if the queue is full.
+     */
+    bool sync_async(Callback<void(int)> callback);
+
+    /** Advance the asynchronous request state machine by one step
+     *
+     * @returns
+     *   'true' if there are still requests in progress,
+     *   'false' if the queue is empty.
+     *
+     * @note Each call transfers at most one sector, and never waits for the card to finish programming.
+     *       Call this from a Ticker, a worker thread, or the main loop. Completion callbacks are invoked
+     *       from the same context, and must not be mixed with blocking disk operations on the same card.
+     *       With SD_USE_RTOS, call it from a thread rather than a Ticker. It returns 'true' without doing
+     *       anything if another thread is in the middle of a transaction.
+     */
+    bool async_poll();
+
+    /** Initialize the card
+     *
+     * @returns The DSTATUS flags (0 if the card is ready).
+     */
+    int disk_initialize();
+
+    /** Write back any queued, cached and gathered sectors, and mark the card as not initialized
+     *
+     * @returns 0 (always succeeds).
+     *
+     * @note Call disk_initialize() again before further disk operations.
+     */
+    int disk_deinitialize();
+
+    /** Get the card status, noticing insertions and removals
+     *
+     * @returns The DSTATUS flags (STA_NOINIT, STA_NODISK and STA_PROTECT).
+     */
+    int disk_status();
+
+    /** Read one or more sectors
+     *
+     * @param buffer The buffer to read the sectors into.
+     * @param sector The first sector to read.
+     * @param count The number of sectors to read.
+     *
+     * @returns The DRESULT code (RES_OK if the sectors were read).
+     */
+    int disk_read(uint8_t* buffer, uint32_t sector, uint32_t count);
+
+    /** Write one or more sectors
+     *
+     * @param buffer The buffer to write the sectors from.
+     * @param sector The first sector to write.
+     * @param count The number of sectors to write.
+     *
+     * @returns The DRESULT code (RES_OK if the sectors were written, or queued, cached or gathered).
+     *
+     * @note Multiple sectors are sent to the card in one multiple block write.
+     */
+    int disk_write(const uint8_t* buffer, uint32_t sector, uint32_t count);
+
+    /** Write back any queued, cached and gathered sectors, and wait for the card to finish programming
+     *
+     * @returns The DRESULT code (RES_OK if everything written so far is on the card).
+     */
+    int disk_sync();
+
+    /** Get the capacity of the card
+     *
+     * @returns The number of 512B sectors (0 if the card isn't initialized).
+     */
+    uint32_t disk_sectors();
+
+private:
+    //Commands
+    enum Command {
+        CMD0 = (0x40 | 0),      /**< GO_IDLE_STATE */
+        CMD1 = (0x40 | 1),      /**< SEND_OP_COND */
+        CMD6 = (0x40 | 6),      /**< SWITCH_FUNC */
+        CMD8 = (0x40 | 8),      /**< SEND_IF_COND */
+        CMD9 = (0x40 | 9),      /**< SEND_CSD */
+        CMD10 = (0x40 | 10),    /**< SEND_CID */
+        CMD12 = (0x40 | 12),    /**< STOP_TRANSMISSION */
+        CMD13 = (0x40 | 13),    /**< SEND_STATUS */
+        CMD16 = (0x40 | 16),    /**< SET_BLOCKLEN */
+        CMD17 = (0x40 | 17),    /**< READ_SINGLE_BLOCK */
+        CMD18 = (0x40 | 18),    /**< READ_MULTIPLE_BLOCK */
+        ACMD22 = (0x40 | 22),   /**< SEND_NUM_WR_BLOCKS */
+        ACMD23 = (0x40 | 23),   /**< SET_WR_BLK_ERASE_COUNT */
+        CMD24 = (0x40 | 24),    /**< WRITE_BLOCK */
+        CMD25 = (0x40 | 25),    /**< WRITE_MULTIPLE_BLOCK */
+        CMD32 = (0x40 | 32),    /**< ERASE_WR_BLK_START_ADDR */
+        CMD33 = (0x40 | 33),    /**< ERASE_WR_BLK_END_ADDR */
+        CMD35 = (0x40 | 35),    /**< ERASE_GROUP_START (MMC) */
+        CMD36 = (0x40 | 36),    /**< ERASE_GROUP_END (MMC) */
+        CMD38 = (0x40 | 38),    /**< ERASE */
+        ACMD41 = (0x40 | 41),   /**< SD_SEND_OP_COND */
+        ACMD42 = (0x40 | 42),   /**< SET_CLR_CARD_DETECT */
+        CMD55 = (0x40 | 55),    /**< APP_CMD */
+        CMD58 = (0x40 | 58),    /**< READ_OCR */
+        CMD59 = (0x40 | 59),    /**< CRC_ON_OFF */
+        ACMD13 = (0x40 | 13)    /**< SD_STATUS */
+    };
+
+    //Asynchronous request operations
+    enum AsyncOp {
+        ASYNC_READ,
+        ASYNC_WRITE,
+        ASYNC_SYNC
+    };
+
+    //Asynchronous request state machine states
+    enum AsyncState {
+        ASYNC_IDLE,         /**< No request in progress */
+        ASYNC_WAIT_READY,   /**< Polling for the card to release the DO line */
+        ASYNC_TRANSFER,     /**< Transferring the next sector */
+        ASYNC_VALIDATE      /**< Verifying the last written sector with CMD13 */
+    };
+
+    //Asynchronous request descriptor
+    struct AsyncRequest {
+        AsyncOp op;
+        uint8_t* buffer;
+        uint32_t sector;
+        uint32_t count;
+        Callback<void(int)> callback;
+    };
+
+    //Member variables
+    Timer m_Timer;
+    SDTransport* m_Spi;
+    SDTransport* m_OwnedTransport;
+    SDNativeTransport* m_Native;
+    InterruptIn m_Cd;
+    int m_CdAssert;
+    int m_Freq;
+    int m_BusFreq;
+    bool m_HighSpeed;
+    bool m_ClockTuning;
+    SDDisk::CardIdentity m_Identity;
+    bool m_Recognized;
+    SDDisk::CardInfo m_Info;
+    unsigned int m_TuneBlocks;
+    unsigned int m_TuneErrors;
+    SDDisk::CardType m_CardType;
+    bool m_Crc;
+    bool m_LargeFrames;
+    SDDisk::ValidationMode m_ValidationMode;
+    int m_ValidationInterval;
+    int m_PendingValidations;
+    bool m_ValidationError;
+    bool m_Dma;
+    SDDisk::WaitMode m_WaitMode;
+    int m_WaitMaxDelay;
+    SDDisk::WaitStats m_BusyWaits;
+    SDDisk::WaitStats m_TokenWaits;
+#if SD_ENABLE_STATS
+    SDStats m_Stats;
+#endif
+    bool m_WriteStreaming;
+    bool m_AuAlignment;
+    bool m_CommandBatching;
+    bool m_StreamOpen;
+    unsigned int m_StreamLba;
+    int m_Status;
+    volatile bool m_CardRemoved;
+    SDMutex m_Mutex;
+    SDSectorCache m_Cache;
+    char* m_GatherBuffer;
+    unsigned int m_GatherSize;
+    unsigned int m_GatherLba;
+    unsigned int m_GatherCount;
+    int m_GatherTimeout;
+    Timer m_GatherTimer;
+    char* m_AheadBuffer;
+    unsigned int m_AheadSize;
+    unsigned int m_AheadLba;
+    unsigned int m_AheadCount;
+    unsigned int m_AheadDepth;
+    unsigned int m_AheadNext;
+    SDWriteRing m_Ring;
+    SDMutex m_RingMutex;
+    volatile bool m_RingError;
+    SDDisk::RingStats m_RingStats;
+#if SD_USE_RTOS
+    Thread* m_RingThread;
+    Semaphore m_RingReady;
+    volatile bool m_RingStop;
+#endif
+    AsyncRequest m_AsyncQueue[SD_ASYNC_QUEUE_SIZE + 1];
+    volatile unsigned int m_AsyncHead;
+    volatile unsigned int m_AsyncTail;
+    SDDisk::AsyncState m_AsyncState;
+    Timer m_AsyncTimer;
+    int m_IdleTimeout;
+    Timer m_IdleTimer;
+    bool m_Suspended;
+    bool m_IdleError;
+    bool m_PoweredOff;
+    DigitalOut* m_Power;
+    int m_PowerOn;
+    int m_PowerRamp;
+    SDDisk::IdleStats m_IdleStats;
+    SDDisk::RecoveryPolicy m_Recovery;
+    SDDisk::RecoveryStats m_RecoveryStats;
+    int m_ClockSteps;
+    int m_ClockCeiling;
+    int m_BurstSteps;
+    unsigned int m_CleanBlocks;
+    char* m_TuneBuffer;
+    int m_CrcSampling;
+    int m_CrcSampleCount;
+    bool m_Checksums;
+    bool m_SidecarActive;
+    unsigned int m_SidecarData;
+    char* m_SidecarBuffer;
+    unsigned int m_SidecarTable;
+    bool m_SidecarDirty;
+    char* m_ScrubBuffer;
+    unsigned int m_ScrubTable;
+    unsigned int m_ScrubNext;
+    SDDisk::ScrubStats m_ScrubStats;
+#if SD_USE_RTOS
+    Thread* m_ScrubThread;
+    Semaphore m_ScrubWake;
+    volatile bool m_ScrubStop;
+    int m_ScrubInterval;
+    int m_ScrubCount;
+#endif
+
+    //Internal methods
+    void init(SwitchType cdtype);
+    void onCardRemoval();
+    void checkSocket();
+    bool crcEnabled() const;
+    bool largeFrames() const;
+    SDDisk::ValidationMode validationMode() const;
+    unsigned int cardAddress(unsigned int lba) const;
+    bool stepAsync();
+    bool queueAsync(AsyncOp op, uint8_t* buffer, uint32_t sector, uint32_t count, Callback<void(int)> callback);
+    void finishAsync(int result);
+    bool pollReady();
+    void pollDelay(int polls);
+    void recordWait(SDDisk::WaitStats* stats, int us, bool timedOut);
+    bool waitReady(int timeout);
+    bool select();
+    void deselect();
+    char commandTransaction(unsigned char cmd, unsigned int arg, unsigned int* resp = NULL, bool app = false);
+    bool chainCommand();
+    bool stopTransmission();
+    char writeCommand(unsigned char cmd, unsigned int arg, unsigned int* resp = NULL, bool app = false);
+    bool sampleRead();
+    bool readData(char* buffer, int length, bool verify = true);
+    bool readData(char* buffer, int length, unsigned short* crc, const char* crcBuffer, unsigned short* bufferCrc);
+    char writeData(const char* buffer, char token, unsigned short crc, const char* crcBuffer, unsigned short* bufferCrc);
+    bool cacheRead(char* buffer, unsigned int lba, unsigned int count);
+    bool cacheWrite(const char* buffer, unsigned int lba, unsigned int count);
+    bool evictSlot(int slot);
+    bool flushCache();
+    bool aheadRead(char* buffer, unsigned int lba, unsigned int count);
+    bool gatherRead(char* buffer, unsigned int lba, unsigned int count);
+    bool gatherWrite(const char* buffer, unsigned int lba, unsigned int count);
+    bool gatherOverlaps(unsigned int lba, unsigned int count);
+    bool flushGather();
+    bool checkGather();
+    bool writeSectors(const char* buffer, unsigned int lba, unsigned int count);
+    int ringWrite(const char* buffer, unsigned int lba, unsigned int count);
+    int syncCard();
+    bool drainRing(unsigned int count);
+#if SD_USE_RTOS
+    void ringTask();
+    void stopRing();
+#endif
+    bool streamWrite(const char* buffer, unsigned int lba, unsigned int count);
+    bool closeStream();
+    bool sessionWrite(const char* buffer, unsigned int lba, unsigned int count);
+    bool cardRead(char* buffer, unsigned int lba, unsigned int count);
+    bool cardWrite(const char* buffer, unsigned int lba, unsigned int count);
+    bool burstWrite(const char* buffer, unsigned int lba, unsigned int count);
+    bool auBoundary(unsigned int lba);
+    bool eraseBlocks(unsigned int lba, unsigned int count);
+    bool readBlock(char* buffer, unsigned int lba, bool verify = false);
+    bool readBlocks(char* buffer, unsigned int lba, unsigned int count);
+    bool writeBlock(const char* buffer, unsigned int lba, bool validate);
+    bool writeBlocks(const char* buffer, unsigned int lba, unsigned int count);
+    bool validateWrite();
+    bool checkValidation();
+    bool finishValidation();
+    bool enableHighSpeedMode();
+    bool readRegister(unsigned char cmd, unsigned int arg, char* buffer, int length, bool app = false);
+    bool recognizeCard();
+    bool knownCard();
+    bool readCardInfo();
+    void rememberCard();
+    void setBusFrequency(int hz);
+    bool tuneRead(char* buffer);
+    bool tuneClock(int hz);
+    void recordRetry(SDDisk::RetryReason reason);
+    unsigned int burstLimit();
+    void checkErrorRate(unsigned int count);
+    bool resumeCard();
+    bool wakeCard();
+    void checkIdle();
+    void powerDown();
+    bool openChecksums();
+    bool loadChecksums(unsigned int table, bool overwrite);
+    bool setChecksums(const char* buffer, unsigned int lba, unsigned int count);
+    bool flushChecksums();
+    int scrubSectors(unsigned int count);
+#if SD_USE_RTOS
+    void scrubTask();
+    void stopScrubber();
+#endif
+};
+
+#endif
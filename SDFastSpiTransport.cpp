@@ -0,0 +1,96 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SDFastSpiTransport.h"
+
+#if SD_FAST_SPI_AVAILABLE
+
+#include "pinmap.h"
+
+//Map the FIFO depth, status flags and data register accesses for each SPI peripheral
+#if defined(TARGET_STM)
+#include "PeripheralPins.h"
+#define FAST_SPI_FIFO_DEPTH 4   //The RX FIFO holds 32 bits
+#define FAST_SPI_TX_READY   (m_Regs->SR & SPI_SR_TXE)
+#define FAST_SPI_RX_READY   (m_Regs->SR & SPI_SR_RXNE)
+#define FAST_SPI_DATA8      (*(volatile uint8_t*)&m_Regs->DR)
+#define FAST_SPI_DATA16     (*(volatile uint16_t*)&m_Regs->DR)
+#else
+#define FAST_SPI_FIFO_DEPTH 8   //The RX FIFO holds 8 frames
+#define FAST_SPI_TX_READY   (m_Regs->SR & (1 << 1))
+#define FAST_SPI_RX_READY   (m_Regs->SR & (1 << 2))
+#define FAST_SPI_DATA8      (m_Regs->DR)
+#define FAST_SPI_DATA16     (m_Regs->DR)
+#endif
+
+SDFastSpiTransport::SDFastSpiTransport(PinName mosi, PinName miso, PinName sclk, PinName cs)
+    : SDSpiTransport(mosi, miso, sclk, cs)
+{
+    //Find the registers of the SPI peripheral the driver picked for the clock pin
+#if defined(TARGET_STM)
+    m_Regs = (SPI_TypeDef*)pinmap_peripheral(sclk, PinMap_SPI_SCLK);
+#else
+    m_Regs = (sclk == P0_7 || sclk == P1_31) ? LPC_SSP1 : LPC_SSP0;
+#endif
+}
+
+int SDFastSpiTransport::write(int value)
+{
+    //Wait for room in the TX FIFO, and send the frame
+    while (!FAST_SPI_TX_READY);
+    if (bits() > 8)
+        FAST_SPI_DATA16 = value;
+    else
+        FAST_SPI_DATA8 = value;
+
+    //Wait for the frame received at the same time, and return it
+    while (!FAST_SPI_RX_READY);
+    return (bits() > 8) ? FAST_SPI_DATA16 : FAST_SPI_DATA8;
+}
+
+bool SDFastSpiTransport::transfer(const char* txBuffer, char* rxBuffer, int length)
+{
+    int sent = 0;
+    int received = 0;
+
+    //Fall back to the frame loop unless 8-bit frames are in use, since the FIFO accesses below are byte wide
+    //(on STM32 this also relies on the driver setting FRXTH for 8-bit frames, so RXNE means one byte is waiting,
+    //and on the driver leaving the peripheral enabled between transfers)
+    if (bits() != 8)
+        return false;
+
+    //Stream the block through the FIFOs
+    while (received < length) {
+        //Keep the TX FIFO topped up, without putting more frames in flight than the RX FIFO can hold
+        while (sent < length && sent - received < FAST_SPI_FIFO_DEPTH && FAST_SPI_TX_READY) {
+            FAST_SPI_DATA8 = (txBuffer != NULL) ? txBuffer[sent] : 0xFF;
+            sent++;
+        }
+
+        //Drain the RX FIFO (discarding the data if there's no receive buffer)
+        while (received < sent && FAST_SPI_RX_READY) {
+            char data = FAST_SPI_DATA8;
+            if (rxBuffer != NULL)
+                rxBuffer[received] = data;
+            received++;
+        }
+    }
+
+    //The block was transferred
+    return true;
+}
+
+#endif
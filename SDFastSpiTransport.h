@@ -0,0 +1,83 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_FAST_SPI_TRANSPORT_H
+#define SD_FAST_SPI_TRANSPORT_H
+
+#include "mbed.h"
+#include "SDSpiTransport.h"
+
+//Determine whether or not this target has a supported SPI peripheral (STM32 SPI with FIFOs, or LPC176x SSP)
+#if defined(TARGET_STM) && defined(SPI_SR_FRLVL)
+#define SD_FAST_SPI_AVAILABLE 1
+#elif defined(TARGET_LPC176X)
+#define SD_FAST_SPI_AVAILABLE 1
+#else
+#define SD_FAST_SPI_AVAILABLE 0
+#endif
+
+#if SD_FAST_SPI_AVAILABLE
+
+/** SDFastSpiTransport class.
+ *  An SDSpiTransport that moves frames through the SPI peripheral's registers directly.
+ *
+ *  The mbed SPI driver still sets up the pins, clocks, frequency and frame size, but frame exchanges and
+ *  block transfers skip the HAL call per frame. Block transfers keep the TX FIFO topped up (with 0xFF
+ *  when there's no data to send) and drain the RX FIFO as it fills, with no more frames in flight than the
+ *  RX FIFO can hold, so an interrupt can't cause an overrun. This keeps the bus busy at 25MHz on targets
+ *  where SPI::write() takes longer than a byte time.
+ *
+ *  Supported targets are STM32 families with SPI FIFOs (such as the F0, F3, F7 and L4) and the LPC176x
+ *  (SSP0 and SSP1). The bus can't be shared with other cards.
+ *
+ * Example:
+ * @code
+ * #include "mbed.h"
+ * #include "SDFileSystem.h"
+ * #include "SDFastSpiTransport.h"
+ *
+ * //Create an SDFileSystem object using register-level SPI transfers
+ * SDFastSpiTransport spi(p5, p6, p7, p20);
+ * SDFileSystem sd(spi, "sd", p8, SDFileSystem::SWITCH_NEG_NO, 25000000);
+ * @endcode
+ */
+class SDFastSpiTransport : public SDSpiTransport
+{
+public:
+    /** Create a fast SPI transport with its own SPI peripheral
+     *
+     * @param mosi The SPI data out pin.
+     * @param miso The SPI data in pin (the internal pull-up resistor is enabled).
+     * @param sclk The SPI clock pin.
+     * @param cs The SPI chip select pin.
+     */
+    SDFastSpiTransport(PinName mosi, PinName miso, PinName sclk, PinName cs);
+
+    virtual int write(int value);
+    virtual bool transfer(const char* txBuffer, char* rxBuffer, int length);
+
+private:
+    //Member variables
+#if defined(TARGET_STM)
+    SPI_TypeDef* m_Regs;
+#else
+    LPC_SSP_TypeDef* m_Regs;
+#endif
+};
+
+#endif
+
+#endif
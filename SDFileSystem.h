@@ -19,10 +19,14 @@
 
 #include "mbed.h"
 #include "FATFileSystem.h"
+#include "SDDisk.h"
 
 /** SDFileSystem class.
  *  Used for creating a virtual file system for accessing SD/MMC cards via SPI.
  *
+ *  The card is driven by the SDDisk base class, so all of its options and statistics are available here,
+ *  and FATFileSystem reaches the card through the disk_*() methods.
+ *
  * Example:
  * @code
  * #include "mbed.h"
@@ -66,29 +70,9 @@
  * }
  * @endcode
  */
-class SDFileSystem : public FATFileSystem
+class SDFileSystem : public FATFileSystem, public SDDisk
 {
 public:
-    /** Represents the different card detect switch types
-     */
-    enum SwitchType {
-        SWITCH_NONE,    /**< No card detect switch (assumes socket is always occupied) */
-        SWITCH_POS_NO,  /**< Switch shorts to VDD when the socket is occupied (positive logic, normally open) */
-        SWITCH_POS_NC,  /**< Switch shorts to VDD when the socket is empty (positive logic, normally closed) */
-        SWITCH_NEG_NO,  /**< Switch shorts to GND when the socket is occupied (negative logic, normally open) */
-        SWITCH_NEG_NC   /**< Switch shorts to GND when the socket is empty (negative logic, normally closed) */
-    };
-
-    /** Represents the different SD/MMC card types
-     */
-    enum CardType {
-        CARD_NONE,      /**< No card is present */
-        CARD_MMC,       /**< MMC card */
-        CARD_SD,        /**< Standard capacity SD card */
-        CARD_SDHC,      /**< High capacity SD card */
-        CARD_UNKNOWN    /**< Unknown or unsupported card */
-    };
-
     /** Create a virtual file system for accessing SD/MMC cards via SPI
      *
      * @param mosi The SPI data out pin.
@@ -102,63 +86,39 @@ public:
      */
     SDFileSystem(PinName mosi, PinName miso, PinName sclk, PinName cs, const char* name, PinName cd = NC, SwitchType cdtype = SWITCH_NONE, int hz = 1000000);
 
-    /** Determine whether or not a card is present
-     *
-     * @returns
-     *   'true' if a card is present,
-     *   'false' if no card is present.
-     */
-    bool card_present();
-
-    /** Get the detected SD/MMC card type
-     *
-     * @returns The detected card type as a CardType enum.
+    /** Create a virtual file system for accessing SD/MMC cards on an SPI bus shared with other cards
      *
-     * @note Valid after the filesystem has been mounted.
-     */
-    SDFileSystem::CardType card_type();
-
-    /** Get whether or not CRC is enabled for commands and data
-     *
-     * @returns
-     *   'true' if CRC is enabled for commands and data,
-     *   'false' if CRC is disabled for commands and data.
-     */
-    bool crc();
-
-    /** Set whether or not CRC is enabled for commands and data
-     *
-     * @param enabled Whether or not to enable CRC for commands and data.
-     */
-    void crc(bool enabled);
-
-    /** Get whether or not 16-bit frames are enabled for data read/write operations
-     *
-     * @returns
-     *   'true' if 16-bit frames will be used during data read/write operations,
-     *   'false' if 8-bit frames will be used during data read/write operations.
+     * @param bus The shared SPI bus (must outlive the file system).
+     * @param cs The SPI chip select pin for this card.
+     * @param name The name used to access the virtual filesystem.
+     * @param cd The card detect pin.
+     * @param cdtype The type of card detect switch.
+     * @param hz The SPI bus frequency (defaults to 1MHz).
      */
-    bool large_frames();
+    SDFileSystem(SDSharedBus& bus, PinName cs, const char* name, PinName cd = NC, SwitchType cdtype = SWITCH_NONE, int hz = 1000000);
 
-    /** Set whether or not 16-bit frames are enabled for data read/write operations
+    /** Create a virtual file system for accessing SD/MMC cards via a custom SPI-mode transport
      *
-     * @param enabled Whether or not 16-bit frames are enabled for data read/write operations.
+     * @param transport The transport used to communicate with the card (must outlive the file system).
+     * @param name The name used to access the virtual filesystem.
+     * @param cd The card detect pin.
+     * @param cdtype The type of card detect switch.
+     * @param hz The bus frequency (defaults to 1MHz).
      */
-    void large_frames(bool enabled);
+    SDFileSystem(SDTransport& transport, const char* name, PinName cd = NC, SwitchType cdtype = SWITCH_NONE, int hz = 1000000);
 
-    /** Get whether or not write validation is enabled for data write operations
+    /** Create a virtual file system for accessing SD cards via a native SD bus transport (such as SDIOTransport)
      *
-     * @returns
-     *   'true' if data writes will be verified using CMD13,
-     *   'false' if data writes will not be verified.
-     */
-    bool write_validation();
-
-    /** Set whether or not write validation is enabled for data write operations
+     * @param transport The transport used to communicate with the card (must outlive the file system).
+     * @param name The name used to access the virtual filesystem.
+     * @param cd The card detect pin.
+     * @param cdtype The type of card detect switch.
+     * @param hz The maximum bus frequency (defaults to 24MHz).
      *
-     * @param enabled Whether or not write validation is enabled for data write operations.
+     * @note The SPI mode options (crc(), large_frames(), dma() and write_streaming()) have no effect, since
+     *       the host controller handles checksums and data transfers itself.
      */
-    void write_validation(bool enabled);
+    SDFileSystem(SDNativeTransport& transport, const char* name, PinName cd = NC, SwitchType cdtype = SWITCH_NONE, int hz = 24000000);
 
     virtual int unmount();
     virtual int disk_initialize();
@@ -167,59 +127,6 @@ public:
     virtual int disk_write(const uint8_t* buffer, uint32_t sector, uint32_t count);
     virtual int disk_sync();
     virtual uint32_t disk_sectors();
-
-private:
-    //Commands
-    enum Command {
-        CMD0 = (0x40 | 0),      /**< GO_IDLE_STATE */
-        CMD1 = (0x40 | 1),      /**< SEND_OP_COND */
-        CMD6 = (0x40 | 6),      /**< SWITCH_FUNC */
-        CMD8 = (0x40 | 8),      /**< SEND_IF_COND */
-        CMD9 = (0x40 | 9),      /**< SEND_CSD */
-        CMD12 = (0x40 | 12),    /**< STOP_TRANSMISSION */
-        CMD13 = (0x40 | 13),    /**< SEND_STATUS */
-        CMD16 = (0x40 | 16),    /**< SET_BLOCKLEN */
-        CMD17 = (0x40 | 17),    /**< READ_SINGLE_BLOCK */
-        CMD18 = (0x40 | 18),    /**< READ_MULTIPLE_BLOCK */
-        ACMD22 = (0x40 | 22),   /**< SEND_NUM_WR_BLOCKS */
-        ACMD23 = (0x40 | 23),   /**< SET_WR_BLK_ERASE_COUNT */
-        CMD24 = (0x40 | 24),    /**< WRITE_BLOCK */
-        CMD25 = (0x40 | 25),    /**< WRITE_MULTIPLE_BLOCK */
-        ACMD41 = (0x40 | 41),   /**< SD_SEND_OP_COND */
-        ACMD42 = (0x40 | 42),   /**< SET_CLR_CARD_DETECT */
-        CMD55 = (0x40 | 55),    /**< APP_CMD */
-        CMD58 = (0x40 | 58),    /**< READ_OCR */
-        CMD59 = (0x40 | 59)     /**< CRC_ON_OFF */
-    };
-
-    //Member variables
-    Timer m_Timer;
-    SPI m_Spi;
-    DigitalOut m_Cs;
-    InterruptIn m_Cd;
-    int m_CdAssert;
-    const int m_FREQ;
-    SDFileSystem::CardType m_CardType;
-    bool m_Crc;
-    bool m_LargeFrames;
-    bool m_WriteValidation;
-    int m_Status;
-
-    //Internal methods
-    void onCardRemoval();
-    void checkSocket();
-    bool waitReady(int timeout);
-    bool select();
-    void deselect();
-    char commandTransaction(char cmd, unsigned int arg, unsigned int* resp = NULL);
-    char writeCommand(char cmd, unsigned int arg, unsigned int* resp = NULL);
-    bool readData(char* buffer, int length);
-    char writeData(const char* buffer, char token);
-    bool readBlock(char* buffer, unsigned int lba);
-    bool readBlocks(char* buffer, unsigned int lba, unsigned int count);
-    bool writeBlock(const char* buffer, unsigned int lba);
-    bool writeBlocks(const char* buffer, unsigned int lba, unsigned int count);
-    bool enableHighSpeedMode();
 };
 
 #endif
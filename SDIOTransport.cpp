@@ -0,0 +1,148 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SDIOTransport.h"
+
+#if SDIO_TRANSPORT_AVAILABLE
+
+//Map the peripheral names used by the STM32F4 (SDIO) and STM32F7/L4 (SDMMC) HALs
+#if defined(SDIO)
+#define SDIO_PERIPHERAL         SDIO
+#define SDIO_EDGE_RISING        SDIO_CLOCK_EDGE_RISING
+#define SDIO_BYPASS_DISABLE     SDIO_CLOCK_BYPASS_DISABLE
+#define SDIO_POWER_SAVE_DISABLE SDIO_CLOCK_POWER_SAVE_DISABLE
+#define SDIO_WIDE_1B            SDIO_BUS_WIDE_1B
+#define SDIO_WIDE_4B            SDIO_BUS_WIDE_4B
+#define SDIO_FLOW_CONTROL       SDIO_HARDWARE_FLOW_CONTROL_ENABLE
+#define SDIO_RESPONSE1(x)       SDIO_GetResponse(x, SDIO_RESP1)
+#else
+#define SDIO_PERIPHERAL         SDMMC1
+#define SDIO_EDGE_RISING        SDMMC_CLOCK_EDGE_RISING
+#define SDIO_BYPASS_DISABLE     SDMMC_CLOCK_BYPASS_DISABLE
+#define SDIO_POWER_SAVE_DISABLE SDMMC_CLOCK_POWER_SAVE_DISABLE
+#define SDIO_WIDE_1B            SDMMC_BUS_WIDE_1B
+#define SDIO_WIDE_4B            SDMMC_BUS_WIDE_4B
+#define SDIO_FLOW_CONTROL       SDMMC_HARDWARE_FLOW_CONTROL_ENABLE
+#define SDIO_RESPONSE1(x)       SDMMC_GetResponse(x, SDMMC_RESP1)
+#endif
+
+SDIOTransport::SDIOTransport()
+{
+    //Start with an empty peripheral handle
+    memset(&m_Sd, 0, sizeof(m_Sd));
+}
+
+bool SDIOTransport::initialize(int hz, bool* highCapacity)
+{
+    //Calculate the transfer clock divider (the bus runs at SDIO_KERNEL_CLOCK / (divider + 2), up to 25MHz)
+    int divider = (SDIO_KERNEL_CLOCK + hz - 1) / hz - 2;
+    if (divider < 0)
+        divider = 0;
+    if (divider > 255)
+        divider = 255;
+
+    //Configure the peripheral (the HAL identifies the card at 400kHz, then switches to this configuration)
+    HAL_SD_DeInit(&m_Sd);
+    m_Sd.Instance = SDIO_PERIPHERAL;
+    m_Sd.Init.ClockEdge = SDIO_EDGE_RISING;
+    m_Sd.Init.ClockBypass = SDIO_BYPASS_DISABLE;
+    m_Sd.Init.ClockPowerSave = SDIO_POWER_SAVE_DISABLE;
+    m_Sd.Init.BusWide = SDIO_WIDE_1B;
+    m_Sd.Init.HardwareFlowControl = SDIO_FLOW_CONTROL;
+    m_Sd.Init.ClockDiv = divider;
+
+    //Identify and select the card (CMD0, CMD8, ACMD41, CMD2, CMD3, CMD9, CMD7)
+    if (HAL_SD_Init(&m_Sd) != HAL_OK)
+        return false;
+
+    //Switch to the 4-bit data bus (ACMD6)
+    if (HAL_SD_ConfigWideBusOperation(&m_Sd, SDIO_WIDE_4B) != HAL_OK)
+        return false;
+
+    //Report the addressing mode
+    *highCapacity = (m_Sd.SdCard.CardType == CARD_SDHC_SDXC);
+    return true;
+}
+
+bool SDIOTransport::read_csd(char* csd)
+{
+    //The HAL reads the CSD register during identification, convert it to bytes MSB first
+    for (int i = 0; i < 4; i++) {
+        csd[i * 4] = m_Sd.CSD[i] >> 24;
+        csd[i * 4 + 1] = m_Sd.CSD[i] >> 16;
+        csd[i * 4 + 2] = m_Sd.CSD[i] >> 8;
+        csd[i * 4 + 3] = m_Sd.CSD[i];
+    }
+    return true;
+}
+
+bool SDIOTransport::read_blocks(char* buffer, unsigned int lba, unsigned int count)
+{
+    //Wait for any previous programming to finish, then read the blocks (CMD17/CMD18, and CMD12)
+    if (!status(500))
+        return false;
+    return (HAL_SD_ReadBlocks(&m_Sd, (uint8_t*)buffer, lba, count, 500) == HAL_OK);
+}
+
+bool SDIOTransport::write_blocks(const char* buffer, unsigned int lba, unsigned int count)
+{
+    //Wait for any previous programming to finish, then write the blocks (CMD24/CMD25, and CMD12)
+    if (!status(500))
+        return false;
+    return (HAL_SD_WriteBlocks(&m_Sd, (uint8_t*)buffer, lba, count, 500) == HAL_OK);
+}
+
+bool SDIOTransport::ready()
+{
+    //Send CMD13 to check if the card is back in the transfer state
+    return (HAL_SD_GetCardState(&m_Sd) == HAL_SD_CARD_TRANSFER);
+}
+
+bool SDIOTransport::status(int timeout)
+{
+    //Poll the card status until programming has finished
+    bool success = false;
+    m_Timer.start();
+    do {
+        //Send CMD13 to the card, and read the full R1 card status (the command fails if the response has errors)
+        if (SDMMC_CmdSendStatus(m_Sd.Instance, (uint32_t)m_Sd.SdCard.RelCardAdd << 16) != HAL_SD_ERROR_NONE)
+            break;
+        uint32_t cardStatus = SDIO_RESPONSE1(m_Sd.Instance);
+
+        //Fail on any error bits (such as WP_VIOLATION, CC_ERROR and ERROR), otherwise stop once it's back in the transfer state
+        if (cardStatus & SDMMC_OCR_ERRORBITS)
+            break;
+        if (((cardStatus >> 9) & 0x0F) == HAL_SD_CARD_TRANSFER) {
+            success = true;
+            break;
+        }
+    } while (m_Timer.read_ms() < timeout);
+    m_Timer.stop();
+    m_Timer.reset();
+
+    //Return whether or not the card is ready without any errors
+    return success;
+}
+
+bool SDIOTransport::erase_blocks(unsigned int lba, unsigned int count)
+{
+    //Wait for any previous programming to finish, then erase the blocks (CMD32, CMD33 and CMD38)
+    if (!status(500))
+        return false;
+    return (HAL_SD_Erase(&m_Sd, lba, lba + count - 1) == HAL_OK);
+}
+
+#endif
@@ -0,0 +1,79 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SDIO_TRANSPORT_H
+#define SDIO_TRANSPORT_H
+
+#include "mbed.h"
+#include "SDNativeTransport.h"
+
+//Determine whether or not this target has a supported 4-bit SD host controller (STM32 SDIO/SDMMC using the Cube HAL)
+#if defined(TARGET_STM) && defined(HAL_SD_MODULE_ENABLED) && (defined(SDIO) || defined(SDMMC1)) && !defined(TARGET_STM32H7)
+#define SDIO_TRANSPORT_AVAILABLE 1
+#else
+#define SDIO_TRANSPORT_AVAILABLE 0
+#endif
+
+/** The SDIO/SDMMC kernel clock frequency in Hz (PLL48CLK on most STM32 parts)
+ */
+#ifndef SDIO_KERNEL_CLOCK
+#define SDIO_KERNEL_CLOCK 48000000
+#endif
+
+#if SDIO_TRANSPORT_AVAILABLE
+
+/** SDIOTransport class.
+ *  An SDNativeTransport using the STM32 SDIO/SDMMC peripheral with a 4-bit data bus.
+ *
+ *  The bus is clocked at up to 24MHz (the kernel clock divided by 2, default speed mode), which moves four bits
+ *  per clock instead of SPI mode's one. The GPIO alternate functions and peripheral clocks are board specific,
+ *  so they must be configured by the application's HAL_SD_MspInit().
+ *
+ * Example:
+ * @code
+ * #include "mbed.h"
+ * #include "SDFileSystem.h"
+ * #include "SDIOTransport.h"
+ *
+ * //Create an SDFileSystem object using the SDIO peripheral
+ * SDIOTransport sdio;
+ * SDFileSystem sd(sdio, "sd", NC, SDFileSystem::SWITCH_NONE, 24000000);
+ * @endcode
+ */
+class SDIOTransport : public SDNativeTransport
+{
+public:
+    /** Create an SDIO transport
+     */
+    SDIOTransport();
+
+    virtual bool initialize(int hz, bool* highCapacity);
+    virtual bool read_csd(char* csd);
+    virtual bool read_blocks(char* buffer, unsigned int lba, unsigned int count);
+    virtual bool write_blocks(const char* buffer, unsigned int lba, unsigned int count);
+    virtual bool ready();
+    virtual bool status(int timeout);
+    virtual bool erase_blocks(unsigned int lba, unsigned int count);
+
+private:
+    //Member variables
+    SD_HandleTypeDef m_Sd;
+    Timer m_Timer;
+};
+
+#endif
+
+#endif
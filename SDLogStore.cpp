@@ -0,0 +1,341 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SDLogStore.h"
+#include "diskio.h"
+#include "SDCRC.h"
+
+namespace
+{
+//Superblock and record header layout
+const uint32_t SUPER_MAGIC = 0x534C4453;    /**< "SDLS" */
+const uint32_t RECORD_MAGIC = 0x524C4453;   /**< "SDLR" */
+const uint32_t HEADER_SIZE = 20;
+
+//Stores a 32-bit little endian value
+void putWord(char* buffer, uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+//Loads a 32-bit little endian value
+uint32_t getWord(const char* buffer)
+{
+    return (uint32_t)(unsigned char)buffer[0] | ((uint32_t)(unsigned char)buffer[1] << 8) | ((uint32_t)(unsigned char)buffer[2] << 16) | ((uint32_t)(unsigned char)buffer[3] << 24);
+}
+
+//Stores a 16-bit little endian value
+void putHalf(char* buffer, unsigned short value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+}
+
+//Loads a 16-bit little endian value
+unsigned short getHalf(const char* buffer)
+{
+    return (unsigned short)((unsigned char)buffer[0] | ((unsigned char)buffer[1] << 8));
+}
+
+//Returns the number of sectors taken up by a record
+inline uint32_t recordSectors(uint32_t length)
+{
+    return (HEADER_SIZE + length + 511) >> 9;
+}
+}
+
+SDLogStore::SDLogStore(SDDisk& disk, uint32_t max_records, int buffer_sectors, uint32_t first, uint32_t count) : m_Disk(disk)
+{
+    //Initialize the member variables
+    m_First = first;
+    m_Count = count;
+    m_Sectors = 0;
+    m_Records = 0;
+    m_Next = 0;
+    m_Epoch = 0;
+    m_Mounted = false;
+    m_BufferFill = 0;
+    m_BufferRecords = 0;
+
+    //Allocate the index and buffer
+    m_Index = (max_records > 0) ? new uint32_t[max_records] : NULL;
+    m_MaxRecords = (m_Index != NULL) ? max_records : 0;
+    m_Buffer = (buffer_sectors > 0) ? new char[buffer_sectors * 512] : NULL;
+    m_BufferSize = (m_Buffer != NULL) ? buffer_sectors : 0;
+}
+
+SDLogStore::~SDLogStore()
+{
+    //Release the index and buffer
+    delete[] m_Index;
+    delete[] m_Buffer;
+}
+
+int SDLogStore::format(bool erase)
+{
+    //Unmount the log, and make sure the range can hold one
+    m_Mounted = false;
+    if (!range())
+        return RES_NOTRDY;
+
+    //Pick a new epoch, so records left over from the previous log aren't mistaken for new ones
+    uint32_t epoch = us_ticker_read();
+    if (m_Disk.disk_read((uint8_t*)m_Sector, m_First, 1) == RES_OK && getWord(m_Sector) == SUPER_MAGIC && getHalf(m_Sector + 8) == SDCRC::crc16(m_Sector, 8))
+        epoch = getWord(m_Sector + 4) + 1;
+
+    //Erase the record area ahead of time if requested
+    if (erase && m_Disk.erase(m_First + 1, m_Sectors - 1) != RES_OK)
+        return RES_ERROR;
+
+    //Clear the first record header, then write the superblock
+    memset(m_Sector, 0, 512);
+    if (m_Disk.disk_write((const uint8_t*)m_Sector, m_First + 1, 1) != RES_OK)
+        return RES_ERROR;
+    putWord(m_Sector, SUPER_MAGIC);
+    putWord(m_Sector + 4, epoch);
+    putHalf(m_Sector + 8, SDCRC::crc16(m_Sector, 8));
+    if (m_Disk.disk_write((const uint8_t*)m_Sector, m_First, 1) != RES_OK)
+        return RES_ERROR;
+
+    //Make sure the new log is on the card
+    return m_Disk.disk_sync();
+}
+
+int SDLogStore::mount()
+{
+    //Start out unmounted and empty, and make sure the range can hold a log
+    m_Mounted = false;
+    m_Records = 0;
+    m_BufferFill = 0;
+    m_BufferRecords = 0;
+    if (!range() || m_BufferSize == 0)
+        return RES_NOTRDY;
+
+    //Read the superblock
+    if (m_Disk.disk_read((uint8_t*)m_Sector, m_First, 1) != RES_OK)
+        return RES_ERROR;
+    if (getWord(m_Sector) != SUPER_MAGIC || getHalf(m_Sector + 8) != SDCRC::crc16(m_Sector, 8))
+        return RES_NOTRDY;
+    m_Epoch = getWord(m_Sector + 4);
+
+    //Follow the record headers until one doesn't belong to this log, indexing the records along the way
+    uint32_t lba = 1;
+    uint32_t length = 0;
+    unsigned short crc = 0;
+    while (m_Records < m_MaxRecords && lba < m_Sectors) {
+        if (m_Disk.disk_read((uint8_t*)m_Sector, m_First + lba, 1) != RES_OK)
+            return RES_ERROR;
+        if (!parseHeader(m_Sector, m_Records, &length, &crc) || lba + recordSectors(length) > m_Sectors)
+            break;
+        m_Index[m_Records++] = lba;
+        lba += recordSectors(length);
+    }
+
+    //Check the payload of the last record, and drop it if a power failure tore it
+    if (m_Records > 0) {
+        uint32_t last = m_Index[m_Records - 1];
+        if (m_Disk.disk_read((uint8_t*)m_Buffer, m_First + last, lba - last) != RES_OK)
+            return RES_ERROR;
+        parseHeader(m_Buffer, m_Records - 1, &length, &crc);
+        if (SDCRC::crc16(m_Buffer + HEADER_SIZE, length) != crc) {
+            m_Records--;
+            lba = last;
+        }
+    }
+
+    //New records go after the last one
+    m_Next = lba;
+    m_Mounted = true;
+    return RES_OK;
+}
+
+int SDLogStore::append(const void* data, uint32_t length)
+{
+    //Make sure the log is mounted and the record fits before proceeding
+    if (!m_Mounted || length > max_length())
+        return -1;
+    uint32_t sectors = recordSectors(length);
+    if (m_Records >= m_MaxRecords || m_Next + sectors > m_Sectors)
+        return -1;
+
+    //Make room in the buffer by writing the records already in it
+    if (m_BufferFill + sectors > m_BufferSize && !flush())
+        return -1;
+
+    //Build the record in the buffer, padding it out to a whole number of sectors
+    char* header = m_Buffer + (m_BufferFill << 9);
+    putWord(header, RECORD_MAGIC);
+    putWord(header + 4, m_Epoch);
+    putWord(header + 8, m_Records);
+    putWord(header + 12, length);
+    putHalf(header + 16, SDCRC::crc16((const char*)data, length));
+    putHalf(header + 18, SDCRC::crc16(header, 18));
+    memcpy(header + HEADER_SIZE, data, length);
+    memset(header + HEADER_SIZE + length, 0, (sectors << 9) - HEADER_SIZE - length);
+
+    //Index the record
+    uint32_t record = m_Records++;
+    m_Index[record] = m_Next;
+    m_Next += sectors;
+    m_BufferFill += sectors;
+    m_BufferRecords++;
+
+    //Write the buffer as soon as it's full
+    if (m_BufferFill == m_BufferSize && !flush())
+        return -1;
+    return record;
+}
+
+int SDLogStore::length(uint32_t record)
+{
+    //Find the record header
+    const char* header = findHeader(record);
+    if (header == NULL)
+        return -1;
+
+    //Return the payload length
+    uint32_t length;
+    unsigned short crc;
+    return parseHeader(header, record, &length, &crc) ? (int)length : -1;
+}
+
+int SDLogStore::read(uint32_t record, void* buffer, uint32_t size)
+{
+    //Find the record header, and make sure the payload fits in the buffer
+    const char* header = findHeader(record);
+    uint32_t length;
+    unsigned short crc;
+    if (header == NULL || !parseHeader(header, record, &length, &crc) || length > size)
+        return -1;
+
+    //Copy the payload straight out of the buffer if it hasn't been written yet
+    char* dst = (char*)buffer;
+    if (header != m_Sector) {
+        memcpy(dst, header + HEADER_SIZE, length);
+        return length;
+    }
+
+    //Copy the start of the payload from the header sector, and read the whole payload sectors straight into the buffer
+    uint32_t lba = m_First + m_Index[record] + 1;
+    uint32_t done = (length < 512 - HEADER_SIZE) ? length : 512 - HEADER_SIZE;
+    memcpy(dst, m_Sector + HEADER_SIZE, done);
+    uint32_t whole = (length - done) >> 9;
+    if (whole > 0 && m_Disk.disk_read((uint8_t*)dst + done, lba, whole) != RES_OK)
+        return -1;
+    done += whole << 9;
+
+    //Finish with the partial sector (if any)
+    if (done < length) {
+        if (m_Disk.disk_read((uint8_t*)m_Sector, lba + whole, 1) != RES_OK)
+            return -1;
+        memcpy(dst + done, m_Sector, length - done);
+    }
+
+    //Check the payload
+    return (SDCRC::crc16(dst, length) == crc) ? (int)length : -1;
+}
+
+int SDLogStore::sync()
+{
+    //Write any buffered records, and wait for the card
+    if (!flush())
+        return RES_ERROR;
+    return m_Disk.disk_sync();
+}
+
+uint32_t SDLogStore::records()
+{
+    //Return the number of records
+    return m_Mounted ? m_Records : 0;
+}
+
+uint32_t SDLogStore::max_length()
+{
+    //Return the space left in the buffer after the header
+    return (m_BufferSize > 0) ? (m_BufferSize << 9) - HEADER_SIZE : 0;
+}
+
+uint32_t SDLogStore::free_sectors()
+{
+    //Return the number of sectors after the end of the log
+    return m_Mounted ? m_Sectors - m_Next : 0;
+}
+
+bool SDLogStore::range()
+{
+    //Use the rest of the card if no size was given
+    uint32_t sectors = m_Disk.disk_sectors();
+    if (m_Count > 0)
+        m_Sectors = (m_First < sectors && m_Count <= sectors - m_First) ? m_Count : 0;
+    else
+        m_Sectors = (m_First < sectors) ? sectors - m_First : 0;
+
+    //Return whether or not there's room for the superblock and a record
+    return (m_Sectors >= 2);
+}
+
+bool SDLogStore::parseHeader(const char* header, uint32_t record, uint32_t* length, unsigned short* crc)
+{
+    //Make sure the header is intact, and belongs to this record of this log
+    if (getWord(header) != RECORD_MAGIC || getHalf(header + 18) != SDCRC::crc16(header, 18))
+        return false;
+    if (getWord(header + 4) != m_Epoch || getWord(header + 8) != record)
+        return false;
+
+    //Make sure the record could have been written through the buffer
+    *length = getWord(header + 12);
+    *crc = getHalf(header + 16);
+    return (*length <= max_length());
+}
+
+const char* SDLogStore::findHeader(uint32_t record)
+{
+    //Make sure the record exists before proceeding
+    if (!m_Mounted || record >= m_Records)
+        return NULL;
+
+    //Records that haven't been written yet are still in the buffer
+    uint32_t buffered = m_Next - m_BufferFill;
+    if (m_Index[record] >= buffered)
+        return m_Buffer + ((m_Index[record] - buffered) << 9);
+
+    //Read the header sector
+    if (m_Disk.disk_read((uint8_t*)m_Sector, m_First + m_Index[record], 1) != RES_OK)
+        return NULL;
+    return m_Sector;
+}
+
+bool SDLogStore::flush()
+{
+    //Get out if there's nothing to write
+    if (m_BufferFill == 0)
+        return true;
+
+    //Write the buffered records in one multiple block write
+    uint32_t lba = m_Next - m_BufferFill;
+    bool success = (m_Disk.disk_write((const uint8_t*)m_Buffer, m_First + lba, m_BufferFill) == RES_OK);
+    if (!success) {
+        //Forget the records that didn't make it to the card
+        m_Records -= m_BufferRecords;
+        m_Next = lba;
+    }
+    m_BufferFill = 0;
+    m_BufferRecords = 0;
+    return success;
+}
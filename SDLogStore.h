@@ -0,0 +1,173 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_LOG_STORE_H
+#define SD_LOG_STORE_H
+
+#include "mbed.h"
+#include "SDDisk.h"
+
+/** SDLogStore class.
+ *  An append-only store of variable length records on a range of sectors, with no file system metadata to update.
+ *
+ *  The first sector of the range holds a superblock with the log's epoch. Each record after it starts on a sector
+ *  boundary with a 20 byte header (magic, epoch, record number, length, payload CRC16 and header CRC16), followed
+ *  by the payload. New records are packed into a RAM buffer and written in sequential multiple block writes.
+ *  mount() rebuilds an in-RAM index of the record locations by following the headers from the start of the log,
+ *  and checks the payload of the last record, so a record torn by a power failure is dropped.
+ *
+ * Example:
+ * @code
+ * #include "mbed.h"
+ * #include "SDDisk.h"
+ * #include "SDLogStore.h"
+ *
+ * SDDisk disk(p5, p6, p7, p20);
+ * SDLogStore log(disk, 1024);
+ *
+ * int main()
+ * {
+ *     //Open the log, creating it if the card doesn't have one yet
+ *     disk.disk_initialize();
+ *     if (log.mount() != 0 && (log.format() != 0 || log.mount() != 0))
+ *         return 1;
+ *
+ *     //Append a record, and make sure it's on the card
+ *     log.append("Hello", 5);
+ *     log.sync();
+ * }
+ * @endcode
+ */
+class SDLogStore
+{
+public:
+    /** Create a log store on a range of sectors
+     *
+     * @param disk The initialized disk to store the log on (must outlive the log store).
+     * @param max_records The number of records the in-RAM index can hold.
+     * @param buffer_sectors The number of sectors buffered in RAM between writes, which also limits the record size (defaults to 8).
+     * @param first The first sector of the range (defaults to 0).
+     * @param count The number of sectors in the range (0 for the rest of the card).
+     */
+    SDLogStore(SDDisk& disk, uint32_t max_records, int buffer_sectors = 8, uint32_t first = 0, uint32_t count = 0);
+
+    /** Destroy the log store, releasing the index and buffer
+     *
+     * @note Call sync() first, since buffered records are discarded.
+     */
+    ~SDLogStore();
+
+    /** Create an empty log, discarding any records already on the range
+     *
+     * @param erase Whether or not to erase the rest of the range too, so later appends don't wait for the card to erase it.
+     *
+     * @returns The DRESULT code.
+     *
+     * @note The log is left unmounted.
+     */
+    int format(bool erase = false);
+
+    /** Open the log, and rebuild the index
+     *
+     * @returns The DRESULT code (RES_NOTRDY if the range doesn't hold a log).
+     */
+    int mount();
+
+    /** Append a record to the log
+     *
+     * @param data The payload of the record.
+     * @param length The number of bytes in the payload (at most max_length()).
+     *
+     * @returns The record number, or -1 if the log isn't mounted, the record is too big, the index or range is full, or a write failed.
+     *
+     * @note The record is held in RAM until the buffer fills up or sync() is called.
+     */
+    int append(const void* data, uint32_t length);
+
+    /** Get the payload length of a record
+     *
+     * @param record The record number.
+     *
+     * @returns The number of bytes in the payload, or -1 if the record doesn't exist or can't be read.
+     */
+    int length(uint32_t record);
+
+    /** Read the payload of a record
+     *
+     * @param record The record number.
+     * @param buffer The buffer to read the payload into.
+     * @param size The size of the buffer in bytes.
+     *
+     * @returns The number of bytes in the payload, or -1 if the record doesn't exist, doesn't fit in the buffer, or fails its CRC16 check.
+     *
+     * @note Whole payload sectors are read straight into the buffer in one multiple block read.
+     */
+    int read(uint32_t record, void* buffer, uint32_t size);
+
+    /** Write any buffered records, and wait for the card to finish programming
+     *
+     * @returns The DRESULT code.
+     */
+    int sync();
+
+    /** Get the number of records in the log
+     *
+     * @returns The number of records appended so far (0 if the log isn't mounted).
+     */
+    uint32_t records();
+
+    /** Get the largest payload a record can hold
+     *
+     * @returns The number of bytes that fit in the buffer after the header.
+     */
+    uint32_t max_length();
+
+    /** Get the number of sectors left for new records
+     *
+     * @returns The number of free sectors after the end of the log.
+     */
+    uint32_t free_sectors();
+
+private:
+    //Member variables
+    SDDisk& m_Disk;
+    uint32_t m_First;
+    uint32_t m_Count;
+    uint32_t m_Sectors;
+    uint32_t* m_Index;
+    uint32_t m_MaxRecords;
+    uint32_t m_Records;
+    uint32_t m_Next;
+    uint32_t m_Epoch;
+    bool m_Mounted;
+    char* m_Buffer;
+    uint32_t m_BufferSize;
+    uint32_t m_BufferFill;
+    uint32_t m_BufferRecords;
+    char m_Sector[512];
+
+    //Internal methods
+    bool range();
+    bool parseHeader(const char* header, uint32_t record, uint32_t* length, unsigned short* crc);
+    const char* findHeader(uint32_t record);
+    bool flush();
+
+    //Not copyable
+    SDLogStore(const SDLogStore&);
+    SDLogStore& operator=(const SDLogStore&);
+};
+
+#endif
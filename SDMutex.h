@@ -0,0 +1,101 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_MUTEX_H
+#define SD_MUTEX_H
+
+#include "SDConfig.h"
+
+/** SDMutex class.
+ *  A recursive mutex that compiles away when SD_USE_RTOS is 0.
+ *
+ * @note Must not be locked from interrupt context.
+ */
+class SDMutex
+{
+public:
+    /** Wait for and lock the mutex
+     */
+    void lock()
+    {
+#if SD_USE_RTOS
+        m_Mutex.lock();
+#endif
+    }
+
+    /** Lock the mutex if it's free
+     *
+     * @returns
+     *   'true' if the mutex was locked,
+     *   'false' if another thread holds it.
+     */
+    bool trylock()
+    {
+#if SD_USE_RTOS
+        return m_Mutex.trylock();
+#else
+        return true;
+#endif
+    }
+
+    /** Unlock the mutex
+     */
+    void unlock()
+    {
+#if SD_USE_RTOS
+        m_Mutex.unlock();
+#endif
+    }
+
+private:
+    //Member variables
+#if SD_USE_RTOS
+    Mutex m_Mutex;
+#endif
+};
+
+/** SDScopedLock class.
+ *  Holds an SDMutex locked for the lifetime of the object.
+ */
+class SDScopedLock
+{
+public:
+    /** Lock a mutex until the end of the enclosing scope
+     *
+     * @param mutex The mutex to lock.
+     */
+    SDScopedLock(SDMutex& mutex) : m_Mutex(mutex)
+    {
+        m_Mutex.lock();
+    }
+
+    /** Unlock the mutex
+     */
+    ~SDScopedLock()
+    {
+        m_Mutex.unlock();
+    }
+
+private:
+    //Member variables
+    SDMutex& m_Mutex;
+
+    //Not copyable
+    SDScopedLock(const SDScopedLock&);
+    SDScopedLock& operator=(const SDScopedLock&);
+};
+
+#endif
@@ -0,0 +1,115 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_NATIVE_TRANSPORT_H
+#define SD_NATIVE_TRANSPORT_H
+
+#include <stddef.h>
+
+/** SDNativeTransport class.
+ *  A native SD bus (SD mode) link between SDFileSystem and a card, such as a 4-bit SDIO/SDMMC peripheral.
+ *
+ *  Native mode sequencing (card identification, relative addresses, bus width selection) and data
+ *  checksums are handled by the host controller, so unlike SDTransport this interface works on whole
+ *  blocks. SDFileSystem keeps everything above the card: the sector cache, write gathering, read-ahead,
+ *  asynchronous requests, write validation policies, and CSD parsing for disk_sectors().
+ */
+class SDNativeTransport
+{
+public:
+    /** Destroy the transport
+     */
+    virtual ~SDNativeTransport() {}
+
+    /** Identify and initialize the card, switching to the widest bus and fastest clock available
+     *
+     * @param hz The maximum bus frequency in Hz.
+     * @param highCapacity Set to whether or not the card uses block addressing (SDHC/SDXC).
+     *
+     * @returns
+     *   'true' if the card is ready for data transfers,
+     *   'false' if initialization failed.
+     */
+    virtual bool initialize(int hz, bool* highCapacity) = 0;
+
+    /** Read the CSD register
+     *
+     * @param csd A 16B buffer for the CSD register, MSB first.
+     *
+     * @returns
+     *   'true' if the CSD register was read,
+     *   'false' if an error occurred.
+     */
+    virtual bool read_csd(char* csd) = 0;
+
+    /** Read 512B blocks from the card
+     *
+     * @param buffer The buffer for the data.
+     * @param lba The first block number.
+     * @param count The number of blocks to read.
+     *
+     * @returns
+     *   'true' if the blocks were read,
+     *   'false' if an error occurred.
+     */
+    virtual bool read_blocks(char* buffer, unsigned int lba, unsigned int count) = 0;
+
+    /** Write 512B blocks to the card
+     *
+     * @param buffer The data to write.
+     * @param lba The first block number.
+     * @param count The number of blocks to write.
+     *
+     * @returns
+     *   'true' if the blocks were accepted by the card,
+     *   'false' if an error occurred.
+     */
+    virtual bool write_blocks(const char* buffer, unsigned int lba, unsigned int count) = 0;
+
+    /** Check whether or not the card has finished programming, without waiting
+     *
+     * @returns
+     *   'true' if the card is ready for the next transfer,
+     *   'false' if the card is still busy.
+     */
+    virtual bool ready() = 0;
+
+    /** Wait for the card to finish programming, and check the card status for errors
+     *
+     * @param timeout The maximum time to wait in milliseconds.
+     *
+     * @returns
+     *   'true' if the card finished programming without errors,
+     *   'false' if it timed out or reported an error.
+     */
+    virtual bool status(int timeout) = 0;
+
+    /** Start erasing a range of 512B blocks (CMD32, CMD33 and CMD38)
+     *
+     * @param lba The first block number.
+     * @param count The number of blocks to erase.
+     *
+     * @returns
+     *   'true' if the erase was started, and should be waited for with status(),
+     *   'false' if an error occurred or erasing isn't supported.
+     */
+    virtual bool erase_blocks(unsigned int /*lba*/, unsigned int /*count*/)
+    {
+        return false;
+    }
+};
+
+#endif
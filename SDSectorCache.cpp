@@ -0,0 +1,178 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SDSectorCache.h"
+
+SDSectorCache::SDSectorCache()
+{
+    //Initialize the member variables
+    m_Entries = NULL;
+    m_Data = NULL;
+    m_Size = 0;
+    m_Clock = 0;
+}
+
+SDSectorCache::~SDSectorCache()
+{
+    //Release the storage
+    resize(0);
+}
+
+bool SDSectorCache::resize(int sectors)
+{
+    //Release the old storage
+    delete[] m_Entries;
+    delete[] m_Data;
+    m_Entries = NULL;
+    m_Data = NULL;
+    m_Size = 0;
+
+    //Allocate the new storage if necessary
+    if (sectors > 0) {
+        m_Entries = new Entry[sectors];
+        m_Data = new char[sectors * 512];
+        if (m_Entries == NULL || m_Data == NULL) {
+            //There wasn't enough memory, leave the cache disabled
+            delete[] m_Entries;
+            delete[] m_Data;
+            m_Entries = NULL;
+            m_Data = NULL;
+            return false;
+        }
+        m_Size = sectors;
+    }
+
+    //Start with every slot empty
+    clear();
+    return true;
+}
+
+int SDSectorCache::size()
+{
+    //Return the number of slots
+    return m_Size;
+}
+
+void SDSectorCache::clear()
+{
+    //Mark every slot as empty
+    for (int i = 0; i < m_Size; i++) {
+        m_Entries[i].valid = false;
+        m_Entries[i].dirty = false;
+        m_Entries[i].stamp = 0;
+    }
+    m_Clock = 0;
+}
+
+void SDSectorCache::discard(uint32_t sector, uint32_t count)
+{
+    //Mark the slots holding sectors in the range as empty
+    for (int i = 0; i < m_Size; i++) {
+        if (m_Entries[i].valid && m_Entries[i].sector - sector < count) {
+            m_Entries[i].valid = false;
+            m_Entries[i].dirty = false;
+        }
+    }
+}
+
+int SDSectorCache::find(uint32_t sector)
+{
+    //Search the slots for the sector
+    for (int i = 0; i < m_Size; i++) {
+        if (m_Entries[i].valid && m_Entries[i].sector == sector) {
+            //Mark the slot as most recently used
+            m_Entries[i].stamp = ++m_Clock;
+            return i;
+        }
+    }
+
+    //The sector isn't cached
+    return -1;
+}
+
+int SDSectorCache::victim()
+{
+    //Prefer an empty slot, otherwise pick the one with the oldest stamp
+    int slot = 0;
+    for (int i = 0; i < m_Size; i++) {
+        if (!m_Entries[i].valid)
+            return i;
+        if ((int32_t)(m_Entries[i].stamp - m_Entries[slot].stamp) < 0)
+            slot = i;
+    }
+
+    //Return the least recently used slot
+    return slot;
+}
+
+int SDSectorCache::nextDirty()
+{
+    //Search the slots for the lowest numbered dirty sector
+    int slot = -1;
+    for (int i = 0; i < m_Size; i++) {
+        if (m_Entries[i].dirty && (slot < 0 || m_Entries[i].sector < m_Entries[slot].sector))
+            slot = i;
+    }
+
+    //Return the dirty slot (if any)
+    return slot;
+}
+
+void SDSectorCache::assign(int slot, uint32_t sector, bool dirty)
+{
+    //Update the slot metadata, and mark it as most recently used
+    m_Entries[slot].sector = sector;
+    m_Entries[slot].valid = true;
+    m_Entries[slot].dirty = dirty;
+    m_Entries[slot].stamp = ++m_Clock;
+}
+
+void SDSectorCache::clean(int slot)
+{
+    //The slot now matches the card
+    m_Entries[slot].dirty = false;
+}
+
+void SDSectorCache::invalidate(int slot)
+{
+    //The slot no longer holds a sector
+    m_Entries[slot].valid = false;
+    m_Entries[slot].dirty = false;
+}
+
+bool SDSectorCache::valid(int slot)
+{
+    //Return whether or not the slot holds a sector
+    return m_Entries[slot].valid;
+}
+
+bool SDSectorCache::dirty(int slot)
+{
+    //Return whether or not the slot is newer than the card
+    return m_Entries[slot].dirty;
+}
+
+uint32_t SDSectorCache::sector(int slot)
+{
+    //Return the sector held by the slot
+    return m_Entries[slot].sector;
+}
+
+char* SDSectorCache::data(int slot)
+{
+    //Return the slot's data buffer
+    return m_Data + (slot * 512);
+}
@@ -0,0 +1,156 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_SECTOR_CACHE_H
+#define SD_SECTOR_CACHE_H
+
+#include "mbed.h"
+
+/** SDSectorCache class.
+ *  Bookkeeping for a small write-back cache of 512B sectors with least recently used replacement.
+ *  The cache never talks to the card itself, the owner is responsible for loading and writing back slots.
+ */
+class SDSectorCache
+{
+public:
+    /** Create an empty (disabled) sector cache
+     */
+    SDSectorCache();
+
+    /** Destroy the sector cache, releasing its storage
+     */
+    ~SDSectorCache();
+
+    /** Change the number of sectors held by the cache, discarding its contents
+     *
+     * @param sectors The number of sectors to hold (0 to disable the cache).
+     *
+     * @returns
+     *   'true' if the storage was allocated,
+     *   'false' if there wasn't enough memory (the cache is left disabled).
+     */
+    bool resize(int sectors);
+
+    /** Get the number of sectors held by the cache
+     *
+     * @returns The number of slots in the cache.
+     */
+    int size();
+
+    /** Discard the contents of every slot, dirty or not
+     */
+    void clear();
+
+    /** Discard the slots holding sectors in a range, dirty or not
+     *
+     * @param sector The first sector in the range.
+     * @param count The number of sectors in the range.
+     */
+    void discard(uint32_t sector, uint32_t count);
+
+    /** Find the slot holding a sector, and mark it as most recently used
+     *
+     * @param sector The sector to look for.
+     *
+     * @returns The slot index, or -1 if the sector isn't cached.
+     */
+    int find(uint32_t sector);
+
+    /** Choose the slot to reuse for a new sector
+     *
+     * @returns An empty slot if there is one, or the least recently used slot otherwise.
+     */
+    int victim();
+
+    /** Find the dirty slot holding the lowest numbered sector
+     *
+     * @returns The slot index, or -1 if there are no dirty slots.
+     */
+    int nextDirty();
+
+    /** Assign a sector to a slot, and mark it as most recently used
+     *
+     * @param slot The slot index.
+     * @param sector The sector now held by the slot.
+     * @param dirty Whether or not the slot is newer than the card.
+     */
+    void assign(int slot, uint32_t sector, bool dirty);
+
+    /** Mark a slot as matching the card
+     *
+     * @param slot The slot index.
+     */
+    void clean(int slot);
+
+    /** Mark a slot as empty, dirty or not
+     *
+     * @param slot The slot index.
+     */
+    void invalidate(int slot);
+
+    /** Get whether or not a slot holds a sector
+     *
+     * @param slot The slot index.
+     *
+     * @returns
+     *   'true' if the slot holds a sector,
+     *   'false' if the slot is empty.
+     */
+    bool valid(int slot);
+
+    /** Get whether or not a slot is newer than the card
+     *
+     * @param slot The slot index.
+     *
+     * @returns
+     *   'true' if the slot needs to be written back,
+     *   'false' if the slot matches the card.
+     */
+    bool dirty(int slot);
+
+    /** Get the sector held by a slot
+     *
+     * @param slot The slot index.
+     *
+     * @returns The sector number.
+     */
+    uint32_t sector(int slot);
+
+    /** Get the 512B data buffer of a slot
+     *
+     * @param slot The slot index.
+     *
+     * @returns A pointer to the slot's data.
+     */
+    char* data(int slot);
+
+private:
+    //Slot metadata
+    struct Entry {
+        uint32_t sector;
+        uint32_t stamp;
+        bool valid;
+        bool dirty;
+    };
+
+    //Member variables
+    Entry* m_Entries;
+    char* m_Data;
+    int m_Size;
+    uint32_t m_Clock;
+};
+
+#endif
@@ -0,0 +1,51 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SDSharedBus.h"
+#include "pinmap.h"
+
+SDSharedBus::SDSharedBus(PinName mosi, PinName miso, PinName sclk)
+    : m_Spi(mosi, miso, sclk)
+{
+    //Nobody owns the bus yet
+    m_Owner = NULL;
+
+    //Enable the internal pull-up resistor on MISO
+    pin_mode(miso, PullUp);
+}
+
+SPI& SDSharedBus::spi()
+{
+    //Return the SPI peripheral
+    return m_Spi;
+}
+
+bool SDSharedBus::lock(const void* owner)
+{
+    //Wait for any other card's transaction to finish
+    m_Mutex.lock();
+
+    //Take ownership of the bus, and report whether or not it changed hands
+    bool changed = (m_Owner != owner);
+    m_Owner = owner;
+    return changed;
+}
+
+void SDSharedBus::unlock()
+{
+    //Let the next card have the bus
+    m_Mutex.unlock();
+}
@@ -0,0 +1,80 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_SHARED_BUS_H
+#define SD_SHARED_BUS_H
+
+#include "mbed.h"
+#include "SDMutex.h"
+
+/** SDSharedBus class.
+ *  An SPI bus shared by several cards, each with its own /CS pin.
+ *
+ *  Every SDSpiTransport created on the bus claims it while its card is selected, so transactions from
+ *  different SDFileSystem instances (and threads, if SD_USE_RTOS is set) are serialized at select()/deselect()
+ *  granularity, and each card's frequency and frame size are re-applied when it takes over the bus. While a
+ *  card is busy programming, it releases the bus between polls so another card can use it.
+ *
+ * Example:
+ * @code
+ * #include "mbed.h"
+ * #include "SDFileSystem.h"
+ *
+ * //Create two SDFileSystem objects on the same SPI bus
+ * SDSharedBus bus(p5, p6, p7);
+ * SDFileSystem sd1(bus, p20, "sd1");
+ * SDFileSystem sd2(bus, p21, "sd2");
+ * @endcode
+ */
+class SDSharedBus
+{
+public:
+    /** Create a shared SPI bus
+     *
+     * @param mosi The SPI data out pin.
+     * @param miso The SPI data in pin (the internal pull-up resistor is enabled).
+     * @param sclk The SPI clock pin.
+     */
+    SDSharedBus(PinName mosi, PinName miso, PinName sclk);
+
+    /** Get the SPI peripheral (only use it while the bus is locked)
+     *
+     * @returns A reference to the SPI peripheral.
+     */
+    SPI& spi();
+
+    /** Lock the bus for the calling card (recursive)
+     *
+     * @param owner The card taking over the bus.
+     *
+     * @returns
+     *   'true' if a different card used the bus last, so the caller must re-apply its configuration,
+     *   'false' if the caller's configuration is still in effect.
+     */
+    bool lock(const void* owner);
+
+    /** Unlock the bus
+     */
+    void unlock();
+
+private:
+    //Member variables
+    SPI m_Spi;
+    const void* m_Owner;
+    SDMutex m_Mutex;
+};
+
+#endif
@@ -0,0 +1,198 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SDSpiTransport.h"
+#include "pinmap.h"
+
+SDSpiTransport::SDSpiTransport(PinName mosi, PinName miso, PinName sclk, PinName cs)
+    : m_Cs(cs, 1)
+{
+    //Create our own SPI peripheral
+    m_Bus = NULL;
+    m_Spi = new SPI(mosi, miso, sclk);
+
+    //Enable the internal pull-up resistor on MISO
+    pin_mode(miso, PullUp);
+    init();
+}
+
+SDSpiTransport::SDSpiTransport(SDSharedBus& bus, PinName cs)
+    : m_Cs(cs, 1)
+{
+    //Use the shared bus's SPI peripheral
+    m_Bus = &bus;
+    m_Spi = &bus.spi();
+    init();
+}
+
+SDSpiTransport::~SDSpiTransport()
+{
+    //Release the SPI peripheral if we created it
+    if (m_Bus == NULL)
+        delete m_Spi;
+}
+
+void SDSpiTransport::frequency(int hz)
+{
+    //Set the SPI bus frequency, remembering it for when we reclaim a shared bus
+    lockBus();
+    m_Hz = hz;
+    m_Spi->frequency(hz);
+    unlockBus();
+}
+
+void SDSpiTransport::format(int bits)
+{
+    //Set the frame size (always using SPI mode 0), remembering it for when we reclaim a shared bus
+    lockBus();
+    m_Bits = bits;
+    m_Spi->format(bits, 0);
+    unlockBus();
+}
+
+int SDSpiTransport::write(int value)
+{
+    //Exchange a frame, claiming a shared bus for frames sent while the card isn't selected
+    if (m_Bus != NULL && !m_Selected) {
+        lockBus();
+        int resp = m_Spi->write(value);
+        unlockBus();
+        return resp;
+    }
+    return m_Spi->write(value);
+}
+
+void SDSpiTransport::chip_select(bool asserted)
+{
+    //Hold a shared bus for as long as the card is selected
+    if (asserted && !m_Selected) {
+        lockBus();
+        m_Selected = true;
+        m_Cs = 0;
+    } else if (!asserted && m_Selected) {
+        m_Cs = 1;
+        m_Selected = false;
+        unlockBus();
+    } else {
+        //The chip select is active low
+        m_Cs = asserted ? 0 : 1;
+    }
+}
+
+bool SDSpiTransport::start_transfer(const char* txBuffer, char* rxBuffer, int length)
+{
+#if DEVICE_SPI_ASYNCH
+    //Hold DI high if there's nothing to send by filling the receive buffer with 0xFF first, since some drivers
+    //(such as the STM32 HAL in 2-line master mode) clock out the receive buffer's contents instead of a fill value
+    if (txBuffer == NULL && rxBuffer != NULL)
+        memset(rxBuffer, 0xFF, length);
+
+    //Start the asynchronous transfer
+    m_TransferDone = false;
+    if (m_Spi->transfer<char>(txBuffer, (txBuffer != NULL) ? length : 0, rxBuffer, (rxBuffer != NULL) ? length : 0, event_callback_t(this, &SDSpiTransport::onTransferComplete), SPI_EVENT_COMPLETE) != 0) {
+        //The peripheral is busy, let the caller fall back to polled transfers
+        m_TransferDone = true;
+        return false;
+    }
+
+    //The transfer is now in progress
+    return true;
+#else
+    //Bulk transfers aren't supported on this target
+    (void)txBuffer;
+    (void)rxBuffer;
+    (void)length;
+    return false;
+#endif
+}
+
+void SDSpiTransport::finish_transfer()
+{
+#if DEVICE_SPI_ASYNCH
+    //Wait for the transfer to complete
+    while (!m_TransferDone);
+#endif
+}
+
+bool SDSpiTransport::transfer(const char* txBuffer, char* rxBuffer, int length)
+{
+#if SD_SPI_BLOCK_TRANSFER
+    //Let the SPI driver stream the block through its FIFO (its default fill value is 0xFF)
+    m_Spi->write(txBuffer, (txBuffer != NULL) ? length : 0, rxBuffer, (rxBuffer != NULL) ? length : 0);
+    return true;
+#else
+    //Block transfers aren't supported by this version of the SPI driver
+    (void)txBuffer;
+    (void)rxBuffer;
+    (void)length;
+    return false;
+#endif
+}
+
+bool SDSpiTransport::shared()
+{
+    //Return whether or not other cards share the bus
+    return (m_Bus != NULL);
+}
+
+int SDSpiTransport::bits()
+{
+    //Return the frame size
+    return m_Bits;
+}
+
+void SDSpiTransport::init()
+{
+    //Initialize the member variables
+    m_Hz = 1000000;
+    m_Bits = 8;
+    m_Selected = false;
+#if DEVICE_SPI_ASYNCH
+    m_TransferDone = true;
+#endif
+
+    //Configure the SPI bus
+    lockBus();
+    m_Spi->format(8, 0);
+#if DEVICE_SPI_ASYNCH
+    m_Spi->set_dma_usage(DMA_USAGE_OPPORTUNISTIC);
+#endif
+    unlockBus();
+}
+
+inline void SDSpiTransport::lockBus()
+{
+    //Claim a shared bus, and re-apply our configuration if another card changed it
+    if (m_Bus != NULL && m_Bus->lock(this)) {
+        m_Spi->format(m_Bits, 0);
+        m_Spi->frequency(m_Hz);
+    }
+}
+
+inline void SDSpiTransport::unlockBus()
+{
+    //Release a shared bus
+    if (m_Bus != NULL)
+        m_Bus->unlock();
+}
+
+#if DEVICE_SPI_ASYNCH
+void SDSpiTransport::onTransferComplete(int /*event*/)
+{
+    //Signal the waiting transfer that the SPI peripheral is done
+    m_TransferDone = true;
+}
+#endif
@@ -0,0 +1,89 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_SPI_TRANSPORT_H
+#define SD_SPI_TRANSPORT_H
+
+#include "mbed.h"
+#include "SDTransport.h"
+#include "SDSharedBus.h"
+
+/** SDSpiTransport class.
+ *  An SDTransport using an mbed SPI peripheral and a DigitalOut for /CS.
+ *  Bulk transfers use SPI::transfer() (DMA where available) on targets with DEVICE_SPI_ASYNCH,
+ *  and block transfers use the polled SPI::write() block API when SD_SPI_BLOCK_TRANSFER is set.
+ */
+class SDSpiTransport : public SDTransport
+{
+public:
+    /** Create an SPI transport with its own SPI peripheral
+     *
+     * @param mosi The SPI data out pin.
+     * @param miso The SPI data in pin (the internal pull-up resistor is enabled).
+     * @param sclk The SPI clock pin.
+     * @param cs The SPI chip select pin.
+     */
+    SDSpiTransport(PinName mosi, PinName miso, PinName sclk, PinName cs);
+
+    /** Create an SPI transport on a shared bus
+     *
+     * @param bus The shared SPI bus (must outlive the transport).
+     * @param cs The SPI chip select pin for this card.
+     */
+    SDSpiTransport(SDSharedBus& bus, PinName cs);
+
+    /** Destroy the transport, releasing its SPI peripheral if it has its own
+     */
+    virtual ~SDSpiTransport();
+
+    virtual void frequency(int hz);
+    virtual void format(int bits);
+    virtual int write(int value);
+    virtual void chip_select(bool asserted);
+    virtual bool start_transfer(const char* txBuffer, char* rxBuffer, int length);
+    virtual void finish_transfer();
+    virtual bool transfer(const char* txBuffer, char* rxBuffer, int length);
+    virtual bool shared();
+
+protected:
+    /** Get the frame size last set with format()
+     *
+     * @returns The number of bits per frame.
+     */
+    int bits();
+
+private:
+    //Member variables
+    SDSharedBus* m_Bus;
+    SPI* m_Spi;
+    DigitalOut m_Cs;
+    int m_Hz;
+    int m_Bits;
+    bool m_Selected;
+#if DEVICE_SPI_ASYNCH
+    volatile bool m_TransferDone;
+#endif
+
+    //Internal methods
+    void init();
+    void lockBus();
+    void unlockBus();
+#if DEVICE_SPI_ASYNCH
+    void onTransferComplete(int event);
+#endif
+};
+
+#endif
@@ -0,0 +1,128 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SDStats.h"
+
+SDHistogram::SDHistogram()
+{
+    //Start empty
+    reset();
+}
+
+void SDHistogram::add(unsigned int value)
+{
+    //Find the power-of-two bucket for the value
+    int bucket = 0;
+    for (unsigned int v = value; v != 0 && bucket < BUCKETS - 1; v >>= 1)
+        bucket++;
+
+    //Update the counters
+    buckets[bucket]++;
+    count++;
+    total += value;
+    if (value > max)
+        max = value;
+}
+
+void SDHistogram::reset()
+{
+    //Clear the counters
+    count = 0;
+    total = 0;
+    max = 0;
+    for (int i = 0; i < BUCKETS; i++)
+        buckets[i] = 0;
+}
+
+unsigned int SDHistogram::mean() const
+{
+    //Return the mean value
+    return (count > 0) ? (unsigned int)(total / count) : 0;
+}
+
+SDStats::SDStats()
+{
+    //Start zeroed
+    reset();
+}
+
+void SDStats::reset()
+{
+    //Clear the histograms
+    command_us.reset();
+    busy_us.reset();
+    token_us.reset();
+    read_sectors.reset();
+    write_sectors.reset();
+
+    //Clear the counters
+    command_crc_retries = 0;
+    read_crc_errors = 0;
+    write_crc_errors = 0;
+    write_rollbacks = 0;
+    read_errors = 0;
+    write_errors = 0;
+    read_bytes = 0;
+    read_us = 0;
+    write_bytes = 0;
+    write_us = 0;
+}
+
+unsigned int SDStats::read_bytes_per_sec() const
+{
+    //Return the average read throughput
+    return (read_us > 0) ? (unsigned int)((read_bytes * 1000000) / read_us) : 0;
+}
+
+unsigned int SDStats::write_bytes_per_sec() const
+{
+    //Return the average write throughput
+    return (write_us > 0) ? (unsigned int)((write_bytes * 1000000) / write_us) : 0;
+}
+
+namespace
+{
+//Prints a histogram as "name,count,mean,max,bucket0,...,bucketN"
+void printHistogram(FILE* out, const char* name, const SDHistogram& histogram)
+{
+    fprintf(out, "%s,%u,%u,%u", name, histogram.count, histogram.mean(), histogram.max);
+    for (int i = 0; i < SDHistogram::BUCKETS; i++)
+        fprintf(out, ",%u", histogram.buckets[i]);
+    fprintf(out, "\n");
+}
+}
+
+void SDStats::print(FILE* out) const
+{
+    //Print the histograms
+    fprintf(out, "# histogram,count,mean,max,buckets...\n");
+    printHistogram(out, "command_us", command_us);
+    printHistogram(out, "busy_us", busy_us);
+    printHistogram(out, "token_us", token_us);
+    printHistogram(out, "read_sectors", read_sectors);
+    printHistogram(out, "write_sectors", write_sectors);
+
+    //Print the counters
+    fprintf(out, "# counter,value\n");
+    fprintf(out, "command_crc_retries,%u\n", command_crc_retries);
+    fprintf(out, "read_crc_errors,%u\n", read_crc_errors);
+    fprintf(out, "write_crc_errors,%u\n", write_crc_errors);
+    fprintf(out, "write_rollbacks,%u\n", write_rollbacks);
+    fprintf(out, "read_errors,%u\n", read_errors);
+    fprintf(out, "write_errors,%u\n", write_errors);
+    fprintf(out, "read_bytes_per_sec,%u\n", read_bytes_per_sec());
+    fprintf(out, "write_bytes_per_sec,%u\n", write_bytes_per_sec());
+}
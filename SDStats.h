@@ -0,0 +1,121 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_STATS_H
+#define SD_STATS_H
+
+#include "mbed.h"
+
+/** Whether or not to collect SDFileSystem statistics (adds a few counter updates to the hot path)
+ */
+#ifndef SD_ENABLE_STATS
+#define SD_ENABLE_STATS 0
+#endif
+
+//Compiles a statistics update in or out
+#if SD_ENABLE_STATS
+#define SD_STATS(x) x
+#else
+#define SD_STATS(x)
+#endif
+
+/** SDHistogram class.
+ *  A power-of-two histogram with a running count, total, and maximum.
+ *  Bucket 0 counts zero values, and bucket n counts values from 2^(n-1) to 2^n - 1.
+ */
+class SDHistogram
+{
+public:
+    /** The number of buckets (the last bucket also counts anything larger)
+     */
+    static const int BUCKETS = 20;
+
+    /** Create an empty histogram
+     */
+    SDHistogram();
+
+    /** Add a value to the histogram
+     *
+     * @param value The value to add.
+     */
+    void add(unsigned int value);
+
+    /** Clear the histogram
+     */
+    void reset();
+
+    /** Get the mean of the values added so far
+     *
+     * @returns The mean value (0 if the histogram is empty).
+     */
+    unsigned int mean() const;
+
+    unsigned int count;             /**< The number of values added */
+    unsigned long long total;       /**< The sum of the values added */
+    unsigned int max;               /**< The largest value added */
+    unsigned int buckets[BUCKETS];  /**< The number of values added to each bucket */
+};
+
+/** SDStats class.
+ *  Performance counters collected by SDFileSystem when SD_ENABLE_STATS is set.
+ */
+class SDStats
+{
+public:
+    /** Create a zeroed set of counters
+     */
+    SDStats();
+
+    /** Clear all counters
+     */
+    void reset();
+
+    /** Get the average read throughput of disk_read()
+     *
+     * @returns The number of bytes read per second.
+     */
+    unsigned int read_bytes_per_sec() const;
+
+    /** Get the average write throughput of disk_write()
+     *
+     * @returns The number of bytes written per second.
+     */
+    unsigned int write_bytes_per_sec() const;
+
+    /** Print every counter and histogram as comma separated values
+     *
+     * @param out The stream to print to.
+     */
+    void print(FILE* out) const;
+
+    SDHistogram command_us;             /**< Command latency in writeCommand(), in microseconds */
+    SDHistogram busy_us;                /**< Busy wait time in waitReady(), in microseconds */
+    SDHistogram token_us;               /**< Start block token wait time in readData(), in microseconds */
+    SDHistogram read_sectors;           /**< Sectors per disk_read() call */
+    SDHistogram write_sectors;          /**< Sectors per disk_write() call */
+    unsigned int command_crc_retries;   /**< Commands retried because the R1 response flagged a CRC error */
+    unsigned int read_crc_errors;       /**< Data blocks read with a bad CRC16 checksum */
+    unsigned int write_crc_errors;      /**< Single block writes rejected with a CRC error data response */
+    unsigned int write_rollbacks;       /**< Multiple block writes rolled back using ACMD22 */
+    unsigned int read_errors;           /**< Failed disk_read() calls */
+    unsigned int write_errors;          /**< Failed disk_write() calls */
+    unsigned long long read_bytes;      /**< Bytes returned by disk_read() */
+    unsigned long long read_us;         /**< Time spent in disk_read(), in microseconds */
+    unsigned long long write_bytes;     /**< Bytes accepted by disk_write() */
+    unsigned long long write_us;        /**< Time spent in disk_write(), in microseconds */
+};
+
+#endif
@@ -0,0 +1,222 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SDStreamFile.h"
+#include "diskio.h"
+
+SDStreamFile::SDStreamFile(SDFileSystem& sd, int buffer_sectors) : m_Sd(sd)
+{
+    //Initialize the member variables
+    memset(&m_File, 0, sizeof(m_File));
+    m_Open = false;
+    m_Capacity = 0;
+    m_Lba = 0;
+    m_Flushed = 0;
+    m_Fill = 0;
+
+    //Allocate the buffer, which needs room for at least one sector
+    if (buffer_sectors < 1)
+        buffer_sectors = 1;
+    m_Buffer = new char[buffer_sectors * 512];
+    m_BufferSize = (m_Buffer != NULL) ? buffer_sectors : 0;
+}
+
+SDStreamFile::~SDStreamFile()
+{
+    //Close the file, and release the buffer
+    close();
+    delete[] m_Buffer;
+}
+
+int SDStreamFile::open(const char* name, uint32_t size)
+{
+    //Close any file that's already open
+    close();
+
+    //Make sure there's something to reserve, and somewhere to buffer it
+    if (size == 0 || m_BufferSize == 0)
+        return FR_INVALID_PARAMETER;
+
+    //Create the file on the file system's drive
+    char path[64];
+    snprintf(path, sizeof(path), "%s:/%s", m_Sd._fsid, name);
+    FRESULT res = f_open(&m_File, path, FA_CREATE_ALWAYS | FA_WRITE);
+    if (res != FR_OK)
+        return res;
+
+    //Reserve the clusters by seeking past the end of the empty file (FatFs stops short if the volume is full)
+    res = f_lseek(&m_File, size);
+    if (res == FR_OK && m_File.fptr != size)
+        res = FR_DENIED;
+
+    //The data is written by sector number, so the clusters have to form one contiguous run
+    if (res == FR_OK && !contiguous())
+        res = FR_DENIED;
+    if (res != FR_OK) {
+        f_close(&m_File);
+        f_unlink(path);
+        return res;
+    }
+
+    //Locate the first sector of the run
+    m_Capacity = size;
+    m_Lba = m_File.fs->database + (m_File.sclust - 2) * m_File.fs->csize;
+    m_Flushed = 0;
+    m_Fill = 0;
+    m_Open = true;
+
+    //Record the reservation with an empty file size
+    return checkpoint();
+}
+
+int SDStreamFile::write(const void* data, uint32_t length)
+{
+    //Make sure the file is open before proceeding
+    if (!m_Open)
+        return -1;
+
+    //Stop at the end of the reservation
+    if (length > m_Capacity - (m_Flushed + m_Fill))
+        length = m_Capacity - (m_Flushed + m_Fill);
+
+    const char* src = (const char*)data;
+    uint32_t remaining = length;
+    while (remaining > 0) {
+        if (m_Fill == 0 && remaining >= 512) {
+            //Write whole sectors straight from the caller's buffer in one burst
+            uint32_t bytes = remaining & ~511;
+            if (m_Sd.disk_write((const uint8_t*)src, m_Lba + (m_Flushed >> 9), bytes >> 9) != RES_OK)
+                return -1;
+            m_Flushed += bytes;
+            src += bytes;
+            remaining -= bytes;
+        } else {
+            //Collect the data in the buffer, and write it once it's full
+            uint32_t chunk = (m_BufferSize << 9) - m_Fill;
+            if (chunk > remaining)
+                chunk = remaining;
+            memcpy(m_Buffer + m_Fill, src, chunk);
+            m_Fill += chunk;
+            src += chunk;
+            remaining -= chunk;
+            if (m_Fill == (m_BufferSize << 9) && !writeBuffer(false))
+                return -1;
+        }
+    }
+
+    //Return the number of bytes written
+    return length;
+}
+
+int SDStreamFile::checkpoint()
+{
+    //Make sure the file is open before proceeding
+    if (!m_Open)
+        return FR_INVALID_OBJECT;
+
+    //Write the buffered data, including any partial sector
+    if (!writeBuffer(true))
+        return FR_DISK_ERR;
+
+    //Update the directory entry with the current size (f_sync() also syncs the card)
+    m_File.fsize = m_Flushed + m_Fill;
+    m_File.flag |= FA__WRITTEN;
+    return f_sync(&m_File);
+}
+
+int SDStreamFile::close()
+{
+    //Make sure the file is open before proceeding
+    if (!m_Open)
+        return FR_INVALID_OBJECT;
+    m_Open = false;
+
+    //Write the buffered data, including any partial sector
+    FRESULT res = writeBuffer(true) ? FR_OK : FR_DISK_ERR;
+
+    //Release the clusters past the end of the data, restoring the reserved size first so the seek doesn't allocate any
+    m_File.fsize = m_Capacity;
+    if (res == FR_OK)
+        res = f_lseek(&m_File, m_Flushed + m_Fill);
+    if (res == FR_OK)
+        res = f_truncate(&m_File);
+
+    //Only keep the sectors known to be on the card if something went wrong
+    if (res != FR_OK) {
+        m_File.fsize = m_Flushed;
+        m_File.flag |= FA__WRITTEN;
+    }
+
+    //Close the file, which updates the directory entry
+    FRESULT closed = f_close(&m_File);
+    return (res != FR_OK) ? res : closed;
+}
+
+bool SDStreamFile::is_open()
+{
+    //Return whether or not the file is open
+    return m_Open;
+}
+
+uint32_t SDStreamFile::size()
+{
+    //Return the number of bytes written so far
+    return m_Flushed + m_Fill;
+}
+
+uint32_t SDStreamFile::capacity()
+{
+    //Return the number of bytes reserved
+    return m_Capacity;
+}
+
+bool SDStreamFile::contiguous()
+{
+    //Follow the cluster chain by seeking to the end of each cluster, since the seek leaves the file on the cluster holding the last byte before it
+    uint32_t bcs = (uint32_t)m_File.fs->csize * 512;
+    uint32_t clusters = (m_File.fsize + bcs - 1) / bcs;
+    for (uint32_t n = 0; n < clusters; n++) {
+        uint32_t ofs = (n + 1 < clusters) ? (n + 1) * bcs : m_File.fsize;
+        if (f_lseek(&m_File, ofs) != FR_OK || m_File.clust != m_File.sclust + n)
+            return false;
+    }
+
+    //Every cluster follows on from the one before it
+    return true;
+}
+
+bool SDStreamFile::writeBuffer(bool partial)
+{
+    //Work out how many sectors to write, padding any partial sector with zeros
+    uint32_t whole = m_Fill >> 9;
+    uint32_t count = whole;
+    if (partial && (m_Fill & 511)) {
+        memset(m_Buffer + m_Fill, 0, 512 - (m_Fill & 511));
+        count++;
+    }
+    if (count == 0)
+        return true;
+
+    //Write the sectors in one burst
+    if (m_Sd.disk_write((const uint8_t*)m_Buffer, m_Lba + (m_Flushed >> 9), count) != RES_OK)
+        return false;
+
+    //Keep any partial sector at the front of the buffer, since it's written again once it fills up
+    m_Flushed += whole << 9;
+    m_Fill -= whole << 9;
+    memmove(m_Buffer, m_Buffer + (whole << 9), m_Fill);
+    return true;
+}
@@ -0,0 +1,149 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_STREAM_FILE_H
+#define SD_STREAM_FILE_H
+
+#include "mbed.h"
+#include "SDFileSystem.h"
+
+/** SDStreamFile class.
+ *  Used for recording a file at close to raw card bandwidth. The file's clusters are reserved as one contiguous
+ *  run when it's opened, and the data is written straight to that range of sectors in multiple block writes,
+ *  so FAT and directory updates don't break up the bursts. The directory entry is only updated by checkpoint()
+ *  and close().
+ *
+ * Example:
+ * @code
+ * #include "mbed.h"
+ * #include "SDFileSystem.h"
+ * #include "SDStreamFile.h"
+ *
+ * SDFileSystem sd(p5, p6, p7, p20, "sd");
+ * SDStreamFile log(sd);
+ *
+ * int main()
+ * {
+ *     //Mount the filesystem, and reserve 16MB for the recording
+ *     sd.mount();
+ *     if (log.open("capture.bin", 16 * 1024 * 1024) != 0)
+ *         return 1;
+ *
+ *     //Record the samples, checkpointing every so often so a power failure loses little
+ *     for (int i = 0; i < 1000; i++) {
+ *         log.write(samples, sizeof(samples));
+ *         if (i % 100 == 99)
+ *             log.checkpoint();
+ *     }
+ *
+ *     //Close the file, releasing the unused part of the reservation
+ *     log.close();
+ *     sd.unmount();
+ * }
+ * @endcode
+ */
+class SDStreamFile
+{
+public:
+    /** Create a streaming file on a mounted SD file system
+     *
+     * @param sd The file system to record to (must outlive the streaming file).
+     * @param buffer_sectors The number of sectors buffered in RAM between bursts (defaults to 8).
+     */
+    SDStreamFile(SDFileSystem& sd, int buffer_sectors = 8);
+
+    /** Close the file (if it's open), and release the buffer
+     */
+    ~SDStreamFile();
+
+    /** Create a file, and reserve a contiguous run of clusters for it
+     *
+     * @param name The name of the file relative to the root of the file system.
+     * @param size The number of bytes to reserve.
+     *
+     * @returns The FRESULT code (FR_OK if the file is ready for writing, FR_DENIED if the volume
+     *          has no contiguous run of free clusters that big).
+     *
+     * @note Any file already open is closed first, and an existing file with the same name is replaced.
+     */
+    int open(const char* name, uint32_t size);
+
+    /** Append data to the file
+     *
+     * @param data The data to write.
+     * @param length The number of bytes to write.
+     *
+     * @returns The number of bytes written (less than length once the reservation is full), or -1 on error.
+     *
+     * @note Whole sectors are written straight from the caller's buffer, and the rest are collected in RAM
+     *       until there's a full buffer to write.
+     */
+    int write(const void* data, uint32_t length);
+
+    /** Write the buffered data, and update the directory entry with the current file size
+     *
+     * @returns The FRESULT code.
+     */
+    int checkpoint();
+
+    /** Write the buffered data, release the unused part of the reservation, and close the file
+     *
+     * @returns The FRESULT code.
+     */
+    int close();
+
+    /** Get whether or not the file is open
+     *
+     * @returns
+     *   'true' if the file is open for writing,
+     *   'false' if it's closed.
+     */
+    bool is_open();
+
+    /** Get the number of bytes written so far
+     *
+     * @returns The size of the file.
+     */
+    uint32_t size();
+
+    /** Get the number of bytes reserved
+     *
+     * @returns The most the file can hold.
+     */
+    uint32_t capacity();
+
+private:
+    //Member variables
+    SDFileSystem& m_Sd;
+    FIL m_File;
+    bool m_Open;
+    uint32_t m_Capacity;
+    uint32_t m_Lba;
+    uint32_t m_Flushed;
+    char* m_Buffer;
+    uint32_t m_BufferSize;
+    uint32_t m_Fill;
+
+    //Internal methods
+    bool contiguous();
+    bool writeBuffer(bool partial);
+
+    //Not copyable
+    SDStreamFile(const SDStreamFile&);
+    SDStreamFile& operator=(const SDStreamFile&);
+};
+
+#endif
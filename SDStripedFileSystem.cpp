@@ -0,0 +1,211 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SDStripedFileSystem.h"
+#include "diskio.h"
+
+SDStripedFileSystem::SDStripedFileSystem(SDFileSystem** cards, int count, const char* name, int stripe_sectors)
+    : FATFileSystem(name),
+      m_Count(count),
+      m_StripeSectors(stripe_sectors)
+{
+    //Copy the list of cards
+    m_Cards = new SDFileSystem*[count];
+    for (int i = 0; i < count; i++)
+        m_Cards[i] = cards[i];
+
+    //Initialize the write completion tracking
+    m_Pending = 0;
+    m_Result = RES_OK;
+}
+
+SDStripedFileSystem::~SDStripedFileSystem()
+{
+    //Release the list of cards
+    delete[] m_Cards;
+}
+
+int SDStripedFileSystem::cards()
+{
+    //Return the number of cards
+    return m_Count;
+}
+
+int SDStripedFileSystem::stripe_sectors()
+{
+    //Return the stripe size
+    return m_StripeSectors;
+}
+
+int SDStripedFileSystem::unmount()
+{
+    //Unmount the filesystem
+    FATFileSystem::unmount();
+
+    //Write back and release every card
+    for (int i = 0; i < m_Count; i++)
+        m_Cards[i]->unmount();
+
+    //Always succeeds
+    return 0;
+}
+
+int SDStripedFileSystem::disk_initialize()
+{
+    //Initialize every card, and combine their status flags
+    int status = 0;
+    for (int i = 0; i < m_Count; i++)
+        status |= m_Cards[i]->disk_initialize();
+
+    //Return the combined disk status
+    return status;
+}
+
+int SDStripedFileSystem::disk_status()
+{
+    //Combine the status flags of every card, so a missing or uninitialized card takes the whole set down
+    int status = 0;
+    for (int i = 0; i < m_Count; i++)
+        status |= m_Cards[i]->disk_status();
+
+    //Return the combined disk status
+    return status;
+}
+
+int SDStripedFileSystem::disk_read(uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    //Read each stripe from its card, through the card's sector cache and read-ahead
+    while (count > 0) {
+        int card;
+        uint32_t cardSector, run;
+        mapSector(sector, &card, &cardSector, &run);
+        if (run > count)
+            run = count;
+
+        int res = m_Cards[card]->disk_read(buffer, cardSector, run);
+        if (res != RES_OK)
+            return res;
+
+        buffer += run << 9;
+        sector += run;
+        count -= run;
+    }
+
+    //The read was successful
+    return RES_OK;
+}
+
+int SDStripedFileSystem::disk_write(const uint8_t* buffer, uint32_t sector, uint32_t count)
+{
+    //Make sure every card is initialized and writable before proceeding
+    int status = disk_status();
+    if (status & STA_NOINIT)
+        return RES_NOTRDY;
+    if (status & STA_PROTECT)
+        return RES_WRPRT;
+
+    //Queue each stripe on its card, advancing all of the cards whenever a queue is full
+    m_Pending = 0;
+    m_Result = RES_OK;
+    while (count > 0) {
+        int card;
+        uint32_t cardSector, run;
+        mapSector(sector, &card, &cardSector, &run);
+        if (run > count)
+            run = count;
+
+        if (!m_Cards[card]->write_async(buffer, cardSector, run, Callback<void(int)>(this, &SDStripedFileSystem::onChunkComplete))) {
+            //The card's queue is full, give up if none of the cards can make progress
+            if (!pollCards())
+                return RES_ERROR;
+            continue;
+        }
+        m_Pending++;
+
+        buffer += run << 9;
+        sector += run;
+        count -= run;
+    }
+
+    //Advance the cards together until every stripe has been written
+    while (m_Pending > 0) {
+        if (!pollCards())
+            return RES_ERROR;
+    }
+
+    //Return the first error reported by any card
+    return m_Result;
+}
+
+int SDStripedFileSystem::disk_sync()
+{
+    //Wait for every card to finish its internal write processes
+    int result = RES_OK;
+    for (int i = 0; i < m_Count; i++) {
+        int res = m_Cards[i]->disk_sync();
+        if (res != RES_OK)
+            result = res;
+    }
+
+    //Return the first error reported by any card
+    return result;
+}
+
+uint32_t SDStripedFileSystem::disk_sectors()
+{
+    //Use the same number of whole stripes from every card, limited by the smallest card
+    uint32_t sectors = 0;
+    for (int i = 0; i < m_Count; i++) {
+        uint32_t cardSectors = m_Cards[i]->disk_sectors();
+        if (i == 0 || cardSectors < sectors)
+            sectors = cardSectors;
+    }
+    sectors -= sectors % m_StripeSectors;
+
+    //Return the total number of sectors in the stripe set
+    return sectors * m_Count;
+}
+
+inline void SDStripedFileSystem::mapSector(uint32_t sector, int* card, uint32_t* cardSector, uint32_t* run)
+{
+    //Find the stripe holding the sector, the card it's on, and how many sectors are left in it
+    uint32_t stripe = sector / m_StripeSectors;
+    uint32_t offset = sector % m_StripeSectors;
+    *card = stripe % m_Count;
+    *cardSector = (stripe / m_Count) * m_StripeSectors + offset;
+    *run = m_StripeSectors - offset;
+}
+
+bool SDStripedFileSystem::pollCards()
+{
+    //Advance every card's request queue by one step, so their busy periods overlap
+    bool busy = false;
+    for (int i = 0; i < m_Count; i++) {
+        if (m_Cards[i]->async_poll())
+            busy = true;
+    }
+
+    //Return whether or not any card still has work to do
+    return busy || m_Pending == 0;
+}
+
+void SDStripedFileSystem::onChunkComplete(int result)
+{
+    //Record the first error, and count the stripe as finished
+    if (result != RES_OK && m_Result == RES_OK)
+        m_Result = result;
+    m_Pending--;
+}
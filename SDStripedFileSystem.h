@@ -0,0 +1,117 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_STRIPED_FILE_SYSTEM_H
+#define SD_STRIPED_FILE_SYSTEM_H
+
+#include "mbed.h"
+#include "FATFileSystem.h"
+#include "SDFileSystem.h"
+
+/** SDStripedFileSystem class.
+ *  Used for creating a single virtual file system striped across several SD cards.
+ *
+ *  Logical sectors are split into stripes of a fixed size, spread round-robin over the cards, so
+ *  large transfers use every card at once. Writes are queued on all of the cards with write_async() and
+ *  advanced together, which overlaps one card's busy periods with transfers to the others. The cards are
+ *  used as raw block devices, and shouldn't be mounted on their own.
+ *
+ * Example:
+ * @code
+ * #include "mbed.h"
+ * #include "SDStripedFileSystem.h"
+ *
+ * //Create two cards on a shared SPI bus, and stripe a file system across them
+ * SDSharedBus bus(p5, p6, p7);
+ * SDFileSystem sd1(bus, p20, "sd1", NC, SDFileSystem::SWITCH_NONE, 25000000);
+ * SDFileSystem sd2(bus, p21, "sd2", NC, SDFileSystem::SWITCH_NONE, 25000000);
+ * SDFileSystem* cards[] = { &sd1, &sd2 };
+ * SDStripedFileSystem sd(cards, 2, "sd");
+ *
+ * int main()
+ * {
+ *     //Let each card release the bus while it's busy
+ *     sd1.wait_mode(SDFileSystem::WAIT_BACKOFF);
+ *     sd2.wait_mode(SDFileSystem::WAIT_BACKOFF);
+ *
+ *     //Mount the striped filesystem
+ *     sd.mount();
+ *
+ *     //Perform a write test
+ *     FILE *fp = fopen("/sd/test.txt", "w");
+ *     if (fp != NULL) {
+ *         fprintf(fp, "We're writing to two SD cards!");
+ *         fclose(fp);
+ *     }
+ *
+ *     //Unmount the filesystem
+ *     sd.unmount();
+ * }
+ * @endcode
+ */
+class SDStripedFileSystem : public FATFileSystem
+{
+public:
+    /** Create a virtual file system striped across several SD cards
+     *
+     * @param cards The cards to stripe across (must outlive the file system).
+     * @param count The number of cards.
+     * @param name The name used to access the virtual filesystem.
+     * @param stripe_sectors The number of consecutive sectors stored on each card before moving on to the next (defaults to 8).
+     *
+     * @note Reformat the file system if the card order, card count, or stripe size changes.
+     */
+    SDStripedFileSystem(SDFileSystem** cards, int count, const char* name, int stripe_sectors = 8);
+
+    /** Destroy the virtual file system
+     */
+    virtual ~SDStripedFileSystem();
+
+    /** Get the number of cards in the stripe set
+     *
+     * @returns The number of cards.
+     */
+    int cards();
+
+    /** Get the stripe size
+     *
+     * @returns The number of consecutive sectors stored on each card.
+     */
+    int stripe_sectors();
+
+    virtual int unmount();
+    virtual int disk_initialize();
+    virtual int disk_status();
+    virtual int disk_read(uint8_t* buffer, uint32_t sector, uint32_t count);
+    virtual int disk_write(const uint8_t* buffer, uint32_t sector, uint32_t count);
+    virtual int disk_sync();
+    virtual uint32_t disk_sectors();
+
+private:
+    //Member variables
+    SDFileSystem** m_Cards;
+    const int m_Count;
+    const int m_StripeSectors;
+    int m_Pending;
+    int m_Result;
+
+    //Internal methods
+    void mapSector(uint32_t sector, int* card, uint32_t* cardSector, uint32_t* run);
+    bool pollCards();
+    void onChunkComplete(int result);
+};
+
+#endif
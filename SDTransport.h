@@ -0,0 +1,111 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_TRANSPORT_H
+#define SD_TRANSPORT_H
+
+#include <stddef.h>
+
+/** SDTransport class.
+ *  The SPI-mode link between SDFileSystem and a card: full duplex frames plus chip select.
+ *
+ *  SDFileSystem uses an SDSpiTransport on real hardware, but any implementation
+ *  (such as SDCardEmulator) can be passed to its transport constructor instead.
+ *  This header has no mbed dependencies, so transports can also be built on a host.
+ */
+class SDTransport
+{
+public:
+    /** Destroy the transport
+     */
+    virtual ~SDTransport() {}
+
+    /** Set the bus frequency
+     *
+     * @param hz The bus frequency in Hz.
+     */
+    virtual void frequency(int hz) = 0;
+
+    /** Set the frame size
+     *
+     * @param bits The number of bits per frame (8 or 16), sent MSB first.
+     */
+    virtual void format(int bits) = 0;
+
+    /** Exchange a single frame
+     *
+     * @param value The frame to send.
+     *
+     * @returns The frame received at the same time.
+     */
+    virtual int write(int value) = 0;
+
+    /** Assert or deassert /CS
+     *
+     * @param asserted Whether or not the card should be selected.
+     */
+    virtual void chip_select(bool asserted) = 0;
+
+    /** Start a bulk transfer of 8-bit frames
+     *
+     * @param txBuffer The data to send (NULL to send 0xFF).
+     * @param rxBuffer The buffer for the received data (NULL to discard it).
+     * @param length The number of bytes to transfer.
+     *
+     * @returns
+     *   'true' if the transfer was started, and must be completed with finish_transfer(),
+     *   'false' if bulk transfers aren't available, and the caller should use write() instead.
+     */
+    virtual bool start_transfer(const char* /*txBuffer*/, char* /*rxBuffer*/, int /*length*/)
+    {
+        return false;
+    }
+
+    /** Wait for the bulk transfer started by start_transfer() to complete
+     */
+    virtual void finish_transfer() {}
+
+    /** Exchange a block of 8-bit frames, returning once it's complete
+     *
+     * @param txBuffer The data to send (NULL to send 0xFF).
+     * @param rxBuffer The buffer for the received data (NULL to discard it).
+     * @param length The number of bytes to transfer.
+     *
+     * @returns
+     *   'true' if the block was transferred,
+     *   'false' if block transfers aren't available, and the caller should use write() instead.
+     *
+     * @note SDFileSystem only passes word-aligned buffers, and the bytes are kept in memory order,
+     *       so implementations are free to move them through a FIFO a word at a time.
+     */
+    virtual bool transfer(const char* /*txBuffer*/, char* /*rxBuffer*/, int /*length*/)
+    {
+        return false;
+    }
+
+    /** Determine whether or not other cards share the bus
+     *
+     * @returns
+     *   'true' if deselecting the card lets another card use the bus,
+     *   'false' if the card has the bus to itself.
+     */
+    virtual bool shared()
+    {
+        return false;
+    }
+};
+
+#endif
@@ -0,0 +1,145 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SDWriteRing.h"
+
+SDWriteRing::SDWriteRing()
+{
+    //Initialize the member variables
+    m_Sectors = NULL;
+    m_Data = NULL;
+    m_Size = 0;
+    m_Head = 0;
+    m_Tail = 0;
+}
+
+SDWriteRing::~SDWriteRing()
+{
+    //Release the storage
+    resize(0);
+}
+
+bool SDWriteRing::resize(int sectors)
+{
+    //Release the old storage
+    delete[] m_Sectors;
+    delete[] m_Data;
+    m_Sectors = NULL;
+    m_Data = NULL;
+    m_Size = 0;
+
+    //Start out empty
+    m_Head = 0;
+    m_Tail = 0;
+
+    //Allocate the new storage if necessary
+    if (sectors > 0) {
+        m_Sectors = new uint32_t[sectors];
+        m_Data = new char[sectors * 512];
+        if (m_Sectors == NULL || m_Data == NULL) {
+            //There wasn't enough memory, leave the ring disabled
+            delete[] m_Sectors;
+            delete[] m_Data;
+            m_Sectors = NULL;
+            m_Data = NULL;
+            return false;
+        }
+        m_Size = sectors;
+    }
+    return true;
+}
+
+int SDWriteRing::size()
+{
+    //Return the number of slots
+    return m_Size;
+}
+
+unsigned int SDWriteRing::count()
+{
+    //The head and tail count up to twice the size, so a full ring can be told apart from an empty one
+    if (m_Size == 0)
+        return 0;
+    return (m_Head + 2 * m_Size - m_Tail) % (2 * m_Size);
+}
+
+bool SDWriteRing::empty()
+{
+    //Return whether or not no sectors are queued
+    return (m_Head == m_Tail);
+}
+
+bool SDWriteRing::full()
+{
+    //Return whether or not every slot is queued
+    return (count() >= (unsigned int)m_Size);
+}
+
+char* SDWriteRing::backData()
+{
+    //Return the data buffer of the slot at the head
+    return m_Data + ((m_Head % m_Size) << 9);
+}
+
+void SDWriteRing::push(uint32_t sector)
+{
+    //Record the sector, then publish the slot to the consumer
+    m_Sectors[m_Head % m_Size] = sector;
+    m_Head = (m_Head + 1) % (2 * m_Size);
+}
+
+char* SDWriteRing::frontData()
+{
+    //Return the data buffer of the slot at the tail
+    return m_Data + ((m_Tail % m_Size) << 9);
+}
+
+uint32_t SDWriteRing::frontSector()
+{
+    //Return the sector of the slot at the tail
+    return m_Sectors[m_Tail % m_Size];
+}
+
+unsigned int SDWriteRing::run()
+{
+    //Count the queued slots that follow on from the tail, stopping where the storage wraps around
+    unsigned int queued = count();
+    unsigned int slot = m_Tail % m_Size;
+    unsigned int length = 0;
+    while (length < queued && slot + length < (unsigned int)m_Size && m_Sectors[slot + length] == m_Sectors[slot] + length)
+        length++;
+
+    //Return the length of the run
+    return length;
+}
+
+void SDWriteRing::pop(unsigned int count)
+{
+    //Hand the slots back to the producer
+    m_Tail = (m_Tail + count) % (2 * m_Size);
+}
+
+bool SDWriteRing::overlaps(uint32_t sector, uint32_t count)
+{
+    //Search the queued slots for a sector in the range
+    for (uint32_t i = m_Tail; i != m_Head; i = (i + 1) % (2 * m_Size)) {
+        if (m_Sectors[i % m_Size] - sector < count)
+            return true;
+    }
+
+    //None of the queued sectors are in the range
+    return false;
+}
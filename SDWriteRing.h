@@ -0,0 +1,133 @@
+/* SD/MMC File System Library
+ * Copyright (c) 2016 Neil Thiessen
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SD_WRITE_RING_H
+#define SD_WRITE_RING_H
+
+#include "mbed.h"
+
+/** SDWriteRing class.
+ *  Bookkeeping for a first in, first out ring of 512B sectors waiting to be written.
+ *  The ring never talks to the card itself, the owner is responsible for draining it. One producer
+ *  and one consumer may use it at the same time without locking, since the producer only moves the
+ *  head and the consumer only moves the tail.
+ */
+class SDWriteRing
+{
+public:
+    /** Create an empty (disabled) write ring
+     */
+    SDWriteRing();
+
+    /** Destroy the write ring, releasing its storage
+     */
+    ~SDWriteRing();
+
+    /** Change the number of sectors held by the ring, discarding its contents
+     *
+     * @param sectors The number of sectors to hold (0 to disable the ring).
+     *
+     * @returns
+     *   'true' if the storage was allocated,
+     *   'false' if there wasn't enough memory (the ring is left disabled).
+     */
+    bool resize(int sectors);
+
+    /** Get the number of sectors held by the ring
+     *
+     * @returns The number of slots in the ring.
+     */
+    int size();
+
+    /** Get the number of sectors waiting to be written
+     *
+     * @returns The number of queued sectors.
+     */
+    unsigned int count();
+
+    /** Get whether or not the ring is empty
+     *
+     * @returns
+     *   'true' if no sectors are queued,
+     *   'false' if there are sectors waiting to be written.
+     */
+    bool empty();
+
+    /** Get whether or not the ring is full
+     *
+     * @returns
+     *   'true' if every slot holds a queued sector,
+     *   'false' if there's room for another sector.
+     */
+    bool full();
+
+    /** Get the 512B data buffer of the next free slot
+     *
+     * @returns A pointer to the slot's data (only valid while the ring isn't full).
+     */
+    char* backData();
+
+    /** Queue the next free slot once its data buffer has been filled
+     *
+     * @param sector The sector the slot is to be written to.
+     */
+    void push(uint32_t sector);
+
+    /** Get the 512B data buffer of the oldest queued sector
+     *
+     * @returns A pointer to the slot's data (only valid while the ring isn't empty).
+     */
+    char* frontData();
+
+    /** Get the oldest queued sector
+     *
+     * @returns The sector number.
+     */
+    uint32_t frontSector();
+
+    /** Get the length of the run of consecutive sectors at the front of the ring
+     *
+     * @returns The number of queued sectors, starting with the oldest, that are consecutive on the card and in memory.
+     */
+    unsigned int run();
+
+    /** Retire the oldest queued sectors once they've been written
+     *
+     * @param count The number of sectors to retire.
+     */
+    void pop(unsigned int count);
+
+    /** Get whether or not any queued sectors fall in a range
+     *
+     * @param sector The first sector in the range.
+     * @param count The number of sectors in the range.
+     *
+     * @returns
+     *   'true' if a sector in the range is waiting to be written,
+     *   'false' if the card already holds the newest copy of the range.
+     */
+    bool overlaps(uint32_t sector, uint32_t count);
+
+private:
+    //Member variables
+    uint32_t* m_Sectors;
+    char* m_Data;
+    int m_Size;
+    volatile uint32_t m_Head;
+    volatile uint32_t m_Tail;
+};
+
+#endif